@@ -30,6 +30,7 @@
  */
 
 #include <assert.h>
+#include <signal.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/socket.h>
@@ -38,16 +39,22 @@
 
 #include <pwd.h>
 #include <unistd.h>
+#include <string>
+#include <vector>
 #define MAX_PATH FILENAME_MAX
 
 #include "App.h"
 #include "Enclave_u.h"
 #include "Oracle/Oracle.h"
+#include "Shared/Config.h"
+#include "Shared/StatusCode.h"
 #include "sgx_urts.h"
 #include "sgx_uae_service.h"
 
-/* Global EID shared by multiple threads */
+/* Global EID shared by multiple threads, the first of global_eids */
 sgx_enclave_id_t global_eid = 0;
+/* All enclave instances, jobs are sharded across them */
+std::vector<sgx_enclave_id_t> global_eids;
 
 typedef struct _sgx_errlist_t {
   sgx_status_t err;
@@ -102,13 +109,13 @@ void print_error_message(sgx_status_t ret) {
 /* Initialize the enclave:
  *   Call sgx_create_enclave to initialize an enclave instance
  */
-int initialize_enclave(void) {
+int initialize_enclave(sgx_enclave_id_t *p_eid) {
   sgx_status_t ret = SGX_ERROR_UNEXPECTED;
 
   /* Call sgx_create_enclave to initialize an enclave instance */
   /* Debug Support: set 2nd parameter to 1 */
   ret = sgx_create_enclave(ENCLAVE_FILENAME, SGX_DEBUG_FLAG, NULL, NULL,
-                           &global_eid, NULL);
+                           p_eid, NULL);
   if (ret != SGX_SUCCESS) {
     print_error_message(ret);
     return -1;
@@ -134,28 +141,117 @@ void o_gettimeofday(long *tv_sec, long *tv_usec) {
 
 time_t o_time(time_t *timer) { return time(timer); }
 
-/* Application entry */
-int SGX_CDECL main(int argc, char *argv[]) {
-  (void)(argc);
-  (void)(argv);
+/* Each enclave instance keeps its own snapshot file */
+static std::string snapshot_filename(int index) {
+  return SNAPSHOT_FILENAME "." + std::to_string(index);
+}
+
+/* Restore the warm state sealed by the previous run, if there is one.
+ * A missing or stale snapshot only means a cold start.
+ */
+void restore_snapshot(sgx_enclave_id_t eid, int index) {
+  std::string filename = snapshot_filename(index);
+  FILE *fp = fopen(filename.c_str(), "rb");
+  if (fp == NULL)
+    return;
+  std::vector<char> sealed;
+  char buffer[BUFSIZ];
+  size_t read_size;
+  while ((read_size = fread(buffer, 1, sizeof buffer, fp)) > 0)
+    sealed.insert(sealed.end(), buffer, buffer + read_size);
+  fclose(fp);
+
+  int status;
+  e_restore(eid, &status, sealed.data(), sealed.size());
+  if (status != StatusCode::Success)
+    printf("Warning: %s ignored: %s\n", filename.c_str(),
+           StatusCode(status).message());
+}
+
+/* Seal the warm state and write it to disk before the enclave is destroyed.
+ * The file is replaced atomically so a crash never leaves half a snapshot.
+ */
+void save_snapshot(sgx_enclave_id_t eid, int index) {
+  size_t sealed_size = 0;
+  int status;
+  e_snapshot(eid, &status, NULL, 0, &sealed_size);
+  if (status != StatusCode::BufferTooSmall) {
+    printf("Error: snapshot failed: %s\n", StatusCode(status).message());
+    return;
+  }
+  std::vector<char> sealed(sealed_size);
+  e_snapshot(eid, &status, sealed.data(), sealed.size(), &sealed_size);
+  if (status != StatusCode::Success) {
+    printf("Error: snapshot failed: %s\n", StatusCode(status).message());
+    return;
+  }
 
-  /* Initialize the enclave */
-  if (initialize_enclave() < 0) {
-    printf("Enter a character before exit ...\n");
-    getchar();
+  std::string filename = snapshot_filename(index);
+  std::string tmp_filename = filename + ".tmp";
+  FILE *fp = fopen(tmp_filename.c_str(), "wb");
+  if (fp == NULL) {
+    printf("Error: cannot open %s\n", tmp_filename.c_str());
+    return;
+  }
+  size_t written_size = fwrite(sealed.data(), 1, sealed_size, fp);
+  if (fclose(fp) != 0 || written_size != sealed_size ||
+      rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+    printf("Error: cannot write %s\n", filename.c_str());
+    remove(tmp_filename.c_str());
+    return;
+  }
+  printf("Info: snapshot of %zu bytes saved to %s\n", sealed_size,
+         filename.c_str());
+}
+
+/* SIGINT/SIGTERM stop the oracle so that the snapshot can be saved */
+void stop_handler(int) { Oracle::global().stop(); }
+
+/* Application entry
+ *   Usage: app [enclave_num] [stress [host]], enclave_num defaults to
+ *   ENCLAVE_NUM, "stress" runs MAX_WORKER concurrent connections to host
+ *   (default STRESS_HOST) with each enclave driven from its own thread
+ */
+int SGX_CDECL main(int argc, char *argv[]) {
+  int enclave_num = argc > 1 ? atoi(argv[1]) : ENCLAVE_NUM;
+  if (enclave_num < 1) {
+    printf("Error: invalid enclave number %s\n", argv[1]);
     return -1;
   }
 
+  /* Initialize the enclaves */
+  global_eids.resize(enclave_num);
+  for (int i = 0; i < enclave_num; i++) {
+    if (initialize_enclave(&global_eids[i]) < 0) {
+      printf("Enter a character before exit ...\n");
+      getchar();
+      return -1;
+    }
+  }
+  global_eid = global_eids[0];
+
   /* Utilize trusted libraries */
   sgx_target_info_t target_info;
   sgx_epid_group_id_t epid;
   sgx_init_quote(&target_info, &epid);
-  int status;
-  e_init(global_eid, &status, &target_info);
-  test();
+  for (int i = 0; i < enclave_num; i++) {
+    int status;
+    e_init(global_eids[i], &status, &target_info);
+    restore_snapshot(global_eids[i], i);
+  }
+  printf("Info: %d enclave(s) initialized.\n", enclave_num);
+  signal(SIGINT, stop_handler);
+  signal(SIGTERM, stop_handler);
+  if (argc > 2 && strcmp(argv[2], "stress") == 0)
+    stress(argc > 3 ? argv[3] : STRESS_HOST);
+  else
+    test();
+  for (int i = 0; i < enclave_num; i++)
+    save_snapshot(global_eids[i], i);
 
-  /* Destroy the enclave */
-  sgx_destroy_enclave(global_eid);
+  /* Destroy the enclaves */
+  for (int i = 0; i < enclave_num; i++)
+    sgx_destroy_enclave(global_eids[i]);
 
   printf("Info: Cxx11DemoEnclave successfully returned.\n");
 
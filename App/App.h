@@ -37,6 +37,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <vector>
+
 #include "sgx_eid.h"   /* sgx_enclave_id_t */
 #include "sgx_error.h" /* sgx_status_t */
 
@@ -59,9 +61,11 @@
 #if defined(__GNUC__)
 #define TOKEN_FILENAME "enclave.token"
 #define ENCLAVE_FILENAME "enclave.signed.so"
+#define SNAPSHOT_FILENAME "enclave.snapshot"
 #endif
 
 extern sgx_enclave_id_t global_eid; /* global enclave id */
+extern std::vector<sgx_enclave_id_t> global_eids; /* all enclave ids */
 
 #if defined(__cplusplus)
 extern "C" {
@@ -0,0 +1,45 @@
+#include "CircuitBreaker.h"
+#include "Shared/Logging.h"
+
+// 是否放行一个请求，放行后须调用 record_success 或 record_failure
+bool CircuitBreaker::allow() {
+  auto until = open_until.load();
+  if (until == 0) {
+    return true;
+  }
+  if (steady_clock::now().time_since_epoch().count() >= until &&
+      !probing.exchange(true)) {
+    // 冷却结束，放行一个试探请求
+    return true;
+  }
+  rejected += 1;
+  return false;
+}
+
+void CircuitBreaker::record_success() {
+  failures = 0;
+  if (open_until.exchange(0) != 0) {
+    LOG("Circuit breaker closed");
+  }
+  probing = false;
+}
+
+void CircuitBreaker::record_failure() {
+  auto count = ++failures;
+  // 试探失败，或者关闭状态下连续失败过多时打开
+  if (probing.exchange(false) ||
+      (count >= threshold && open_until.load() == 0)) {
+    open_until = (steady_clock::now() + cooldown).time_since_epoch().count();
+    opened += 1;
+    ERROR("Circuit breaker opened after %d consecutive failures", count);
+  }
+}
+
+CircuitBreaker::State CircuitBreaker::get_state() const {
+  auto until = open_until.load();
+  if (until == 0) {
+    return Closed;
+  }
+  return steady_clock::now().time_since_epoch().count() < until ? Open
+                                                                : HalfOpen;
+}
@@ -0,0 +1,49 @@
+#ifndef _A_CIRCUITBREAKER_H_
+#define _A_CIRCUITBREAKER_H_
+
+#include <stddef.h>
+#include <atomic>
+#include <chrono>
+
+using namespace std::chrono;
+
+// 熔断器：连续失败达到 threshold 次后打开，cooldown 内拒绝所有请求；
+// 冷却结束后半开，只放行一个试探请求，成功则关闭，失败则再次打开
+// 只使用原子变量，可在多个线程中同时调用
+class CircuitBreaker {
+ public:
+  enum State {
+    Closed,
+    Open,
+    HalfOpen,
+  };
+
+ protected:
+  const int threshold;
+  const steady_clock::duration cooldown;
+  // 连续失败的次数
+  std::atomic<int> failures = 0;
+  // 打开状态结束的时刻（steady_clock 的计数），为 0 时关闭
+  std::atomic<steady_clock::rep> open_until = 0;
+  // 半开状态下已经放行了试探请求
+  std::atomic<bool> probing = false;
+
+ public:
+  // 打开的次数和因打开而拒绝的请求数
+  std::atomic<size_t> opened = 0;
+  std::atomic<size_t> rejected = 0;
+
+  CircuitBreaker(int threshold, steady_clock::duration cooldown)
+      : threshold(threshold), cooldown(cooldown) {}
+
+  // 是否放行一个请求，放行后须调用 record_success 或 record_failure
+  bool allow();
+
+  void record_success();
+
+  void record_failure();
+
+  State get_state() const;
+};
+
+#endif  // _A_CIRCUITBREAKER_H_
@@ -0,0 +1,49 @@
+#ifndef _A_ENCLAVERESULT_H_
+#define _A_ENCLAVERESULT_H_
+
+#include <stddef.h>
+#include <string.h>
+#include <memory>
+#include <string>
+#include "sgx_report.h"
+
+// Enclave 返回的结果，缓冲区按 e_work 查询到的大小分配，由 e_get_result
+// 直接写入，之后只能移动不能复制，交给使用者时不再复制数据
+class EnclaveResult {
+ protected:
+  std::unique_ptr<char[]> buffer;
+  size_t buffer_size = 0;
+
+ public:
+  sgx_report_t report;
+  // IAS 对 report 对应 quote 的验证报告（回复的 body）
+  std::string verification;
+  // verification 的签名和证书链已在 App 中验证通过，使用者无需再次验证
+  bool verified = false;
+
+  EnclaveResult() = default;
+  // 分配 size 字节，不进行初始化
+  explicit EnclaveResult(size_t size)
+      : buffer(new char[size]), buffer_size(size) {}
+
+  EnclaveResult(const EnclaveResult &) = delete;
+  EnclaveResult &operator=(const EnclaveResult &) = delete;
+  EnclaveResult(EnclaveResult &&) = default;
+  EnclaveResult &operator=(EnclaveResult &&) = default;
+
+  // 复制一份，合并的任务需要各自持有结果时使用
+  EnclaveResult copy() const {
+    EnclaveResult result(buffer_size);
+    memcpy(result.data(), data(), buffer_size);
+    result.report = report;
+    result.verification = verification;
+    result.verified = verified;
+    return result;
+  }
+
+  char *data() { return buffer.get(); }
+  const char *data() const { return buffer.get(); }
+  size_t size() const { return buffer_size; }
+};
+
+#endif  // _A_ENCLAVERESULT_H_
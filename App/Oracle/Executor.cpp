@@ -1,23 +1,33 @@
 #include "Executor.h"
+#include <string.h>
 #include <boost/bind.hpp>
+#include <charconv>
 #include <iostream>
+#include <string_view>
+#include <vector>
 #include "App/deps/base64.h"
 #include "Executor_port.h"
 #include "Oracle.h"
 #include "Shared/deps/http_parser.h"
+#include "Shared/deps/sha256.h"
 #include "sgx_uae_service.h"
 #include "IAS_port.h"
 
 using namespace boost::asio;
 
-EnclaveResult Executor::enclave_result;
-
 // 在 Enclave 中创建对应的对象
-void Executor::init_enclave_ssl(const std::string& hostname,
-                                const std::string& request, int id) {
+void Executor::init_enclave_ssl(sgx_enclave_id_t eid,
+                                const std::string& hostname,
+                                const std::string& request, int id,
+                                bool streaming, Kind kind,
+                                int connection_id) {
   int status;
-  e_new_ssl(global_eid, &status, id, hostname.data(), hostname.size(),
-            request.data(), request.size());
+  if (kind == Connection) {
+    e_new_connection(eid, &status, id, hostname.data(), hostname.size());
+  } else {
+    e_new_ssl(eid, &status, id, hostname.data(), hostname.size(),
+              request.data(), request.size(), streaming, connection_id);
+  }
   ASSERT(status == StatusCode::Success);
 }
 
@@ -40,6 +50,46 @@ void Executor::resolve_callback(boost::shared_ptr<Executor> p_executor,
   Oracle::global().need_work(std::move(p_executor));
 }
 
+// IAS 请求中固定的部分，每次只需填入 Content-Length 和 quote
+static constexpr std::string_view ias_request_head =
+    "POST /sgx/dev/attestation/v3/report HTTP/1.1\r\n"
+    "Content-Type: application/json\r\n"
+    "Host: api.trustedservices.intel.com\r\n"
+    "Ocp-Apim-Subscription-Key: 141e8ac09b50434ea6b35198cf635090\r\n"
+    "Content-Length: ";
+static constexpr std::string_view ias_body_head =
+    "\r\n\r\n{\"isvEnclaveQuote\":\"";
+static constexpr std::string_view ias_body_tail = "\"}\r\n\r\n";
+
+// 生成使用 IAS API 的请求：按最终长度一次分配，quote 直接 Base64 编码到
+// 请求中，不产生中间字符串
+static std::string build_ias_request(const sgx_quote_t* quote,
+                                     size_t quote_size) {
+  auto b64_size = base64_encoded_size(quote_size);
+  // 请求体为 {"isvEnclaveQuote":"<quote>"}，ias_body_head 中前 4 个字符
+  // 是头部的结尾，ias_body_tail 中后 4 个字符在请求体之外
+  auto body_size = ias_body_head.size() - 4 + b64_size +
+                   ias_body_tail.size() - 4;
+  char length[24];
+  auto length_size =
+      std::to_chars(length, length + sizeof(length), body_size).ptr - length;
+  std::string request(ias_request_head.size() + length_size +
+                          ias_body_head.size() + b64_size +
+                          ias_body_tail.size(),
+                      '\0');
+  auto p = &request[0];
+  auto put = [&p](const char* data, size_t size) {
+    memcpy(p, data, size);
+    p += size;
+  };
+  put(ias_request_head.data(), ias_request_head.size());
+  put(length, length_size);
+  put(ias_body_head.data(), ias_body_head.size());
+  p += base64_encode((const unsigned char*)quote, quote_size, p);
+  put(ias_body_tail.data(), ias_body_tail.size());
+  return request;
+}
+
 // 启动 IAS 的请求
 void Executor::ias_request(boost::shared_ptr<Executor> p_executor,
                            sgx_report_t report) {
@@ -53,26 +103,26 @@ void Executor::ias_request(boost::shared_ptr<Executor> p_executor,
   // 获取 quote 大小
   unsigned quote_size;
   sgx_calc_quote_size(sigrl, sigrl_size, &quote_size);
-  // 获得 quote
-  auto quote = (sgx_quote_t*)malloc(quote_size);
+  // 获得 quote，quote 大小不变，每个线程复用同一块缓冲区
+  thread_local std::vector<uint8_t> quote_buffer;
+  quote_buffer.resize(quote_size);
+  auto quote = (sgx_quote_t*)quote_buffer.data();
   sgx_get_quote(&report, SGX_LINKABLE_SIGNATURE, (const sgx_spid_t*)spid,
                 nullptr, nullptr, 0, nullptr, quote, quote_size);
-  // Base64 编码
-  auto b64_quote = base64_encode((unsigned char*)quote, quote_size);
-  free(quote);
-  // 生成使用 IAS API 的请求
-  auto hostname = "api.trustedservices.intel.com"s;
-  auto request_body = "{\"isvEnclaveQuote\":\""s + b64_quote + "\"}"s;
-  auto request =
-      "POST /sgx/dev/attestation/v3/report HTTP/1.1\r\n"
-      "Content-Type: application/json\r\n"
-      "Host: api.trustedservices.intel.com\r\n"
-      "Ocp-Apim-Subscription-Key: 141e8ac09b50434ea6b35198cf635090\r\n"
-      "Content-Length: "s +
-      std::to_string(request_body.size()) + "\r\n\r\n"s + request_body +
-      "\r\n\r\n"s;
+  // 签名每次都不同，以不含签名的 quote body 查找已有的 IAS 回复，
+  // 任务重试或结果相同时不再请求 IAS
+  auto key = sha256(
+      std::string((const char*)quote, offsetof(sgx_quote_t, signature_len)));
+  std::string cached_report;
+  bool verified;
+  if (find_ias_report(key, cached_report, verified)) {
+    LOG("Executor %d reused IAS report", p_executor->id);
+    ias_callback(std::move(p_executor), cached_report, verified);
+    return;
+  }
+  auto request = build_ias_request(quote, quote_size);
   // 连接 IAS 服务
-  send_ias(p_executor, request);
+  send_ias(p_executor, std::move(request), std::move(key));
   // p_executor->ssl_client = create_SSLClient(
   //     p_executor->id, hostname, request, p_executor->ctx,
   //     boost::bind(ias_callback, p_executor->shared_from_this(), _1));
@@ -102,14 +152,15 @@ void Executor::connect_callback(boost::shared_ptr<Executor> p_executor,
 
 // 使用 SSLClient 进行 IAS 确认之后的回调
 void Executor::ias_callback(boost::shared_ptr<Executor> p_executor,
-                            const std::string& response) {
+                            const std::string& response, bool verified) {
   auto& executor = *p_executor;
   if (response.empty()) {
-    // 出现错误
+    // 出现错误，下次 work 时返回
     executor.async_error();
-    return;
   } else {
     LOG("IAS done %d", executor.id);
+    executor.result.verification = response;
+    executor.result.verified = verified;
     executor.state = Finished;
     executor.error_code = StatusCode::Success;
   }
@@ -118,19 +169,26 @@ void Executor::ias_callback(boost::shared_ptr<Executor> p_executor,
 }
 
 void executor_ias_callback(boost::shared_ptr<Executor> p_executor,
-                           const std::string& response) {
-  Executor::ias_callback(p_executor, response);
+                           const std::string& response, bool verified) {
+  Executor::ias_callback(p_executor, response, verified);
 }
 
-Executor::Executor(io_context& ctx, int id, const std::string& hostname,
-                   const std::string& request)
-    : hostname(hostname),
+Executor::Executor(io_context& ctx, int id, sgx_enclave_id_t eid,
+                   const std::string& hostname, const std::string& request,
+                   StreamHandler on_chunk, Kind kind, int connection_id)
+    : state(kind == Stream ? Process : Resolve),
+      hostname(hostname),
       resolver(ctx),
       start_time(steady_clock::now()),
       id(id),
+      eid(eid),
+      kind(kind),
+      connection_id(connection_id),
       ctx(ctx),
-      socket(ctx) {
-  init_enclave_ssl(hostname, request, id);
+      socket(ctx),
+      on_chunk(std::move(on_chunk)) {
+  init_enclave_ssl(eid, hostname, request, id, (bool)this->on_chunk, kind,
+                   connection_id);
 }
 
 void Executor::async_error() {
@@ -142,7 +200,9 @@ void Executor::async_error() {
 bool Executor::work() {
   if (blocking) {
     // 正在进行异步操作，尚未结束
-    if (steady_clock::now() - start_time > TASK_TIMEOUT) {
+    // 已连接的 Connection 长期存在，直到对方关闭或出错
+    if ((kind != Connection || state != Process) &&
+        steady_clock::now() - start_time > TASK_TIMEOUT) {
       // 超时时，关闭连接
       throw StatusCode(StatusCode::Timeout);
     }
@@ -170,19 +230,38 @@ bool Executor::work() {
       case Process: {
         // 由 Enclave 进行处理
         int status;
-        e_work(global_eid, &status, id, &enclave_result);
+        size_t result_size;
+        e_work(eid, &status, id, &result_size);
         if (StatusCode(status).is_error()) {
           throw StatusCode(status);
         }
         if (status == StatusCode::Success) {
-          // 处理完成
+          // 处理完成，按结果长度分配空间，由 Enclave 直接写入
+          result = EnclaveResult(result_size);
+          e_get_result(eid, &status, id, result.data(), result.size(),
+                       &result.report);
+          if (StatusCode(status).is_error()) {
+            throw StatusCode(status);
+          }
           LOG("Executor %d processing done", id);
           socket.close();
           state = Attest;
           // 执行下一步
           continue;
         } else if (status == StatusCode::Blocking) {
-          // 阻塞中
+          // 阻塞中，Stream 没有 socket 事件，等待连接通过 o_ready 唤醒
+          if (kind == Stream) {
+            blocking = true;
+          }
+          return false;
+        } else if (status == StatusCode::Quoting) {
+          // 响应已接收，等待本轮结束时批量生成 report
+          Oracle::global().request_quote(eid);
+          return false;
+        } else if (status == StatusCode::Throttled) {
+          // Enclave 内存紧张，暂不读取，等待 Oracle 在内存释放后恢复
+          blocking = true;
+          Oracle::global().throttle(shared_from_this());
           return false;
         }
         UNREACHABLE();
@@ -190,7 +269,7 @@ bool Executor::work() {
       case Attest: {
         blocking = true;
         dispatch(ctx, boost::bind(ias_request, shared_from_this(),
-                                  enclave_result.report));
+                                  result.report));
         return false;
       }
       case Finished: {
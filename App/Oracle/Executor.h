@@ -6,11 +6,12 @@
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/shared_ptr.hpp>
 #include <chrono>
+#include <functional>
 #include <string>
 #include "App/App.h"
 #include "App/Enclave_u.h"
+#include "EnclaveResult.h"
 #include "Shared/Config.h"
-#include "Shared/EnclaveResult.h"
 #include "Shared/StatusCode.h"
 
 using namespace boost::asio;
@@ -18,7 +19,22 @@ using namespace std::chrono;
 
 class SSLClient;
 
+// 流式模式下接收 Enclave 交出的响应明文，数据仅在调用期间有效
+// 在 report 经过 IAS 确认之前，这些数据还不能被信任
+typedef std::function<void(const char* data, size_t size)> StreamHandler;
+
 class Executor : public boost::enable_shared_from_this<Executor> {
+ public:
+  enum Kind {
+    // 独占一个 socket 的 HTTP/1.1 任务
+    Request,
+    // HTTP/2 连接，不产生结果，由挂载在其上的 Stream 共用 socket
+    Connection,
+    // HTTP/2 连接上的一个 stream，没有自己的 socket，连接的 e_work 推进它，
+    // 结束时通过 o_ready 唤醒
+    Stream,
+  };
+
  protected:
   enum State {
     // 解析域名
@@ -41,12 +57,16 @@ class Executor : public boost::enable_shared_from_this<Executor> {
   ip::tcp::resolver::results_type endpoints;
   // 访问 IAS 所用
   boost::shared_ptr<SSLClient> ssl_client;
+  // Enclave 返回的结果，完成后由 take_result 移交
+  EnclaveResult result;
   // 开始时间
   const time_point<steady_clock> start_time;
 
   // 在 Enclave 中创建对应的对象
-  static void init_enclave_ssl(const std::string& hostname,
-                               const std::string& request, int id);
+  static void init_enclave_ssl(sgx_enclave_id_t eid,
+                               const std::string& hostname,
+                               const std::string& request, int id,
+                               bool streaming, Kind kind, int connection_id);
 
   // 解析域名之后的回调
   static void resolve_callback(boost::shared_ptr<Executor> p_executor,
@@ -64,23 +84,34 @@ class Executor : public boost::enable_shared_from_this<Executor> {
 
  public:
   // 使用 SSLClient 进行 IAS 确认之后的回调
+  // verified 表示回复的签名和证书链已经验证通过，且 quote 状态可以接受
   static void ias_callback(boost::shared_ptr<Executor> p_executor,
-                           const std::string& response);
+                           const std::string& response, bool verified = false);
 
   // 在 map<int, Executor> 中的 key，也是 Enclave 的 o_recv 和 o_send 查找的标识
   const int id;
+  // 任务所在的 Enclave，e_work 等 ECALL 都发往这里
+  const sgx_enclave_id_t eid;
+  const Kind kind;
+  // Stream 所在 Connection 的 id，其他为 -1
+  const int connection_id;
   // 需要使用这个 context 来进行许多操作
   io_context& ctx;
   // o_recv 和 o_send 需要通过 Executor 来找到对应的 socket
   ip::tcp::socket socket;
+  // 非空时使用流式模式，o_stream 将响应分段交给它
+  const StreamHandler on_chunk;
+  // o_recv 读取数据的缓冲区，每个连接独占，Enclave 在 ocall 返回后从中复制
+  char recv_buffer[SOCKET_RECV_BUFFER_SIZE];
   // 调用 o_recv 或 o_send 出现阻塞时置 true，然后通过 async_wait 置 false
   // 遍历所有 Executor 时会略过正在阻塞的
   std::atomic<bool> blocking = false;
-  // Enclave 返回结果
-  static EnclaveResult enclave_result;
 
-  Executor(io_context& ctx, int id, const std::string& hostname,
-           const std::string& request);
+  // Connection 的 request 为空，Stream 须与其 Connection 在同一 Enclave
+  Executor(io_context& ctx, int id, sgx_enclave_id_t eid,
+           const std::string& hostname, const std::string& request,
+           StreamHandler on_chunk = nullptr, Kind kind = Request,
+           int connection_id = -1);
 
   // 异步回调发现错误，调用此函数置错误标记，下次 work 时返回错误
   void async_error();
@@ -88,6 +119,16 @@ class Executor : public boost::enable_shared_from_this<Executor> {
   // 执行工作，返回是否完成，错误则抛出
   bool work();
 
+  const std::string& get_hostname() const { return hostname; }
+
+  time_point<steady_clock> get_start_time() const { return start_time; }
+
+  // 完成后读取 Enclave 返回的结果
+  const EnclaveResult& peek_result() const { return result; }
+
+  // 移交 Enclave 返回的结果，之后 Executor 中的结果为空
+  EnclaveResult take_result() { return std::move(result); }
+
   // 关闭所有 socket，在释放前必须 close() 且 context 执行完回调
   void close();
 
@@ -6,7 +6,9 @@
 
 class Executor;
 
+// verified 表示回复的签名和证书链已经验证通过，且 quote 状态可以接受
 void executor_ias_callback(boost::shared_ptr<Executor> p_executor,
-                            const std::string& response);
+                           const std::string& response,
+                           bool verified = false);
 
 #endif  // _A_EXECUTOR_PORT_H_
\ No newline at end of file
@@ -5,6 +5,8 @@
 #include <boost/beast/http.hpp>
 #include <boost/thread.hpp>
 #include <boost/thread/lock_guard.hpp>
+#include <mutex>
+#include <random>
 #include "Executor_port.h"
 #include "IAS_port.h"
 #include "Oracle_port.h"
@@ -19,115 +21,214 @@ io_context IAS::ctx;
 ssl::context ssl_ctx(ssl::context::method::sslv23_client);
 
 // 初始化全局变量和 IAS 池
+// 可能在 Oracle 的多个线程中同时调用，只执行一次
 void IAS::initialize_context() {
-  static bool initialized = false;
-  if (!initialized) {
-    initialized = true;
+  static std::once_flag initialized;
+  std::call_once(initialized, []() {
     // 加载 CA 根证书
     ssl_ctx.load_verify_file("App/Oracle/ca_certs.pem");
-    // 启动线程令 ctx 工作
-    auto executor = []() {
-      while (true) {
-        ctx.run();
-        ctx.restart();
-      }
-    };
-    boost::thread t(executor);
-    // 让池中 IAS 开始工作
+    // 加载 IAS 报告签名的根证书
+    verifier.load_root(IAS_ROOT_CA_FILE);
+    // 池中的 IAS 在各自的 strand 中启动，之后一直存在
     for (int i = 0; i < IAS_POOL_SIZE; i += 1) {
-      ias_pool[i].index = i;
-      spawn_ias(i);
+      auto& ias = ias_pool[i];
+      ias.index = i;
+      ias.wake.expires_at(steady_timer::time_point::max());
+      spawn(ias.io_strand, [&ias](auto yield) { ias.async_process(yield); });
     }
-  }
+    // 启动线程令 ctx 工作，work guard 使 run() 不会在空闲时返回
+    static auto guard = make_work_guard(ctx);
+    for (int i = 0; i < IAS_THREADS; i += 1) {
+      boost::thread t([]() { ctx.run(); });
+    }
+  });
 }
 
 // 等待进行 IAS 的任务
-std::list<std::tuple<boost::shared_ptr<Executor>, std::string>> IAS::tasks;
-boost::mutex IAS::task_mutex;
+MpmcQueue<IAS::Task, 2 * MAX_WORKER> IAS::tasks;
+MpmcQueue<int, next_power_of_2(IAS_POOL_SIZE)> IAS::idle_ias;
 // IAS 池，每个 IAS 对应一个 SSL 连接
 IAS IAS::ias_pool[IAS_POOL_SIZE];
-std::list<int> IAS::idle_ias;
+// 成功的 IAS 回复，以 quote body 的 SHA-256 为 key
+std::unordered_map<std::string, IAS::CachedReport> IAS::reports;
+std::deque<std::string> IAS::report_order;
+boost::mutex IAS::report_mutex;
+std::atomic<size_t> IAS::avoided_calls = 0;
+// IAS 的健康状态和重试预算
+CircuitBreaker IAS::breaker(IAS_BREAKER_THRESHOLD, IAS_BREAKER_COOLDOWN);
+std::atomic<int> IAS::retry_tokens = IAS_RETRY_RESERVE * 100;
+std::atomic<size_t> IAS::request_count = 0;
+std::atomic<size_t> IAS::failure_count = 0;
+std::atomic<size_t> IAS::retry_count = 0;
+std::atomic<size_t> IAS::exhausted_count = 0;
+std::atomic<size_t> IAS::unverified_count = 0;
+IasVerifier IAS::verifier;
 
-// 执行的主流程
-void IAS::async_process(yield_context yield) {
-  LOG("IAS %d started", index);
-  // 解析域名
-  if (endpoints.empty()) {
-    ip::tcp::resolver resolver(ctx);
-    do {
-      try {
+// 各项统计和熔断器的状态，用于日志
+std::string IAS::metrics() {
+  static const char* states[] = {"closed", "open", "half-open"};
+  char buffer[256];
+  snprintf(buffer, sizeof(buffer),
+           "IAS: %lu requests, %lu failures, %lu retries, %lu out of budget, "
+           "%lu avoided, %lu unverified; breaker %s, opened %lu, rejected %lu",
+           (unsigned long)request_count, (unsigned long)failure_count,
+           (unsigned long)retry_count, (unsigned long)exhausted_count,
+           (unsigned long)avoided_calls, (unsigned long)unverified_count,
+           states[breaker.get_state()],
+           (unsigned long)breaker.opened, (unsigned long)breaker.rejected);
+  return buffer;
+}
+
+// 查找 IAS_CACHE_TTL 内得到的回复，命中时写入 report 和是否通过验证，
+// 并返回 true
+bool IAS::find_report(const std::string& key, std::string& report,
+                      bool& verified) {
+  boost::lock_guard lock(report_mutex);
+  auto found = reports.find(key);
+  if (found == reports.end() ||
+      steady_clock::now() - found->second.time > IAS_CACHE_TTL) {
+    return false;
+  }
+  report = found->second.report;
+  verified = found->second.verified;
+  avoided_calls += 1;
+  return true;
+}
+
+// 加入一个 IAS 回复
+void IAS::save_report(const std::string& key, const std::string& report,
+                      bool verified) {
+  boost::lock_guard lock(report_mutex);
+  auto& entry = reports[key];
+  if (entry.report.empty()) {
+    report_order.push_back(key);
+  }
+  entry = CachedReport{steady_clock::now(), report, verified};
+  while (report_order.size() > IAS_CACHE_SIZE) {
+    reports.erase(report_order.front());
+    report_order.pop_front();
+  }
+}
+
+// 关闭连接，连续失败时按指数退避等待后返回
+void IAS::reset(yield_context yield) {
+  if (stream) {
+    boost::system::error_code ec;
+    get_lowest_layer(*stream).socket().close(ec);
+    stream.reset();
+  }
+  ssl_connected = false;
+  if (failures == 0) {
+    return;
+  }
+  // 在 [0, delay] 中随机（full jitter），避免所有连接同时重连
+  static thread_local std::mt19937 mt(std::random_device{}());
+  steady_clock::duration delay = IAS_BACKOFF_BASE;
+  for (int i = 1; i < failures && delay < IAS_BACKOFF_MAX; i += 1) {
+    delay *= 2;
+  }
+  delay = std::min<steady_clock::duration>(delay, IAS_BACKOFF_MAX);
+  delay = std::uniform_int_distribution<steady_clock::rep>(
+              0, delay.count())(mt) *
+          steady_clock::duration(1);
+  LOG("IAS %d backing off for %ld ms", index,
+      (long)duration_cast<milliseconds>(delay).count());
+  steady_timer timer(io_strand, delay);
+  boost::system::error_code ec;
+  timer.async_wait(yield[ec]);
+}
+
+// 建立 TCP 和 SSL 连接，失败时退避后重试，直到成功
+void IAS::connect(yield_context yield) {
+  while (!ssl_connected) {
+    try {
+      // 解析域名
+      if (endpoints.empty()) {
+        ip::tcp::resolver resolver(io_strand);
         endpoints = resolver.async_resolve(ias_hostname, "https", yield);
-      } catch (const boost::system::system_error& e) {
-        ERROR("IAS %d resolving hostname failed: %s", index, e.what());
-        continue;
+        LOG("IAS %d hostname resolved", index);
       }
-    } while (false);
-    LOG("IAS %d hostname resolved", index);
+      stream.emplace(io_strand, ssl_ctx);
+      // TCP
+      get_lowest_layer(*stream).expires_after(TASK_TIMEOUT);
+      get_lowest_layer(*stream).async_connect(endpoints, yield);
+      // SSL
+      stream->async_handshake(ssl::stream_base::client, yield);
+      ssl_connected = true;
+    } catch (const boost::system::system_error& e) {
+      ERROR("IAS %d handshake failed: %s", index, e.what());
+      failures += 1;
+      breaker.record_failure();
+      if (breaker.get_state() == CircuitBreaker::Open) {
+        // 没有可用的连接，已经排队的任务同样直接失败
+        Task task;
+        while (tasks.pop(task)) {
+          breaker.rejected += 1;
+          executor_ias_callback(std::move(task.p_executor), "");
+        }
+      }
+      reset(yield);
+    }
   }
+  LOG("IAS %d connected", index);
+}
+
+// 执行的主流程
+void IAS::async_process(yield_context yield) {
+  LOG("IAS %d started", index);
   // 循环：握手，然后不断执行任务，如果中断则从握手重来
   while (true) {
-    // 建立连接
-    do {
-      try {
-        // TCP
-        if (!tcp_connected) {
-          get_lowest_layer(stream).expires_after(TASK_TIMEOUT);
-          get_lowest_layer(stream).async_connect(endpoints, yield);
-          tcp_connected = true;
-        }
-        // SSL
-        if (!ssl_connected) {
-          stream.async_handshake(ssl::stream_base::client, yield);
-          ssl_connected = true;
-        }
-      } catch (const boost::system::system_error& e) {
-        ERROR("IAS %d handshake failed: %s", index, e.what());
-        tcp_connected = ssl_connected = false;
-        get_lowest_layer(stream).close();
-        stream.async_shutdown(yield);
-        continue;
-      }
-    } while (false);
-    LOG("IAS %d connected", index);
+    connect(yield);
     // 执行任务
     while (true) {
-      boost::shared_ptr<Executor> p_executor;
-      std::string request;
+      Task task;
       try {
-        // 取出一个任务
-        {
-          boost::lock_guard lock(task_mutex);
-          if (tasks.empty()) {
-            // 无任务执行，退出
-            LOG("IAS %d exit", index);
-            // 将自己标注为空闲
-            idle_ias.push_back(index);
-            return;
-          }
-          LOG("IAS %d processing task", index);
-          auto& task = tasks.front();
-          p_executor = std::get<0>(task);
-          request = std::get<1>(task);
-          tasks.pop_front();
-        }
+        // 取出一个任务，没有时在这里等待
+        wait_task(task, yield);
+        LOG("IAS %d processing task", index);
+        task.attempts += 1;
+        request_count += 1;
         // 发送请求
-        get_lowest_layer(stream).expires_after(TASK_TIMEOUT);
-        async_write(stream, const_buffer(request.data(), request.size()),
+        get_lowest_layer(*stream).expires_after(TASK_TIMEOUT);
+        async_write(*stream,
+                    const_buffer(task.request.data(), task.request.size()),
                     yield);
         // 接收回复
         streambuf buffer;
         http::response<http::string_body> response;
-        http::async_read(stream, buffer, response, yield);
+        http::async_read(*stream, buffer, response, yield);
         INFO("IAS %d response: %s", index, response.body().c_str());
-        executor_ias_callback(p_executor, response.body());
+        failures = 0;
+        if (response.result_int() >= 500) {
+          // IAS 过载或故障，连接本身仍然可用
+          ERROR("IAS %d got status %u", index, response.result_int());
+          breaker.record_failure();
+          retry_or_fail(std::move(task));
+          continue;
+        }
+        breaker.record_success();
+        bool verified = false;
+        if (response.result() == http::status::ok) {
+          verified = verifier.verify(
+              response.body(),
+              std::string(response["X-IASReport-Signature"]),
+              std::string(response["X-IASReport-Signing-Certificate"]),
+              task.key);
+          if (!verified) {
+            unverified_count += 1;
+          }
+          save_report(task.key, response.body(), verified);
+        }
+        executor_ias_callback(std::move(task.p_executor), response.body(),
+                              verified);
       } catch (const boost::system::system_error& e) {
         ERROR("IAS %d task failed: %s", index, e.what());
-        // 出现错误，将任务重新放回队列
-        if (p_executor) {
-          send_ias(p_executor, request);
+        failures += 1;
+        if (task.p_executor) {
+          breaker.record_failure();
+          retry_or_fail(std::move(task));
         }
-        get_lowest_layer(stream).close();
-        tcp_connected = ssl_connected = false;
+        reset(yield);
         break;
       }
     }
@@ -135,34 +236,131 @@ void IAS::async_process(yield_context yield) {
   UNREACHABLE();
 }
 
-void IAS::spawn_ias(int index) {
-  spawn(ctx, [index](auto yield) { ias_pool[index].async_process(yield); });
+// 取出一个任务，队列为空时加入 idle_ias 并等待 wake
+// 检查队列和开始等待在 io_strand 的同一个 handler 中，send_task 投递到
+// io_strand 的唤醒要么在开始等待之后执行，要么在检查之前执行（此时任务
+// 已经在队列中），因此不会错过
+void IAS::wait_task(Task& task, yield_context yield) {
+  while (!tasks.pop(task)) {
+    if (!idle.exchange(true)) {
+      // 先设置 idle 再检查 queued：send_task 在取出 index 之后才清除 queued
+      // 并检查 idle，沿用留下的 index 时一定会被它看到
+      if (!queued.exchange(true)) {
+        idle_ias.push(int(index));
+      }
+      // 加入 idle_ias 之前放入的任务不会唤醒这里，需要再检查一次；取到任务
+      // 时清除 idle，send_task 取出留下的 index 时跳过这里。idle 已被清除
+      // 说明 send_task 刚选中这里，它的任务还在队列中，转交给另一个 IAS
+      if (tasks.pop(task)) {
+        if (!idle.exchange(false)) {
+          wake_one();
+        }
+        return;
+      }
+    }
+    boost::system::error_code ec;
+    // 被 cancel 唤醒时 ec 为 operation_aborted
+    wake.async_wait(yield[ec]);
+  }
+}
+
+IAS::IAS() : io_strand(ctx.get_executor()), wake(io_strand) {}
+
+// 新任务存入重试预算
+void IAS::deposit_retry() {
+  auto tokens = retry_tokens.load();
+  while (tokens < IAS_RETRY_RESERVE * 100 &&
+         !retry_tokens.compare_exchange_weak(
+             tokens,
+             std::min(tokens + IAS_RETRY_PERCENT, IAS_RETRY_RESERVE * 100))) {
+  }
+}
+
+// 从重试预算中取出一次重试，不足时返回 false
+bool IAS::take_retry() {
+  auto tokens = retry_tokens.load();
+  do {
+    if (tokens < 100) {
+      return false;
+    }
+  } while (!retry_tokens.compare_exchange_weak(tokens, tokens - 100));
+  return true;
+}
+
+// 任务失败，允许时重新放入队列，否则以失败结束
+void IAS::retry_or_fail(Task&& task) {
+  failure_count += 1;
+  // 半开状态下 allow 会占用唯一的试探机会，放行后任务必须发出并记录结果，
+  // 所以放在最后检查
+  if (task.attempts >= IAS_MAX_ATTEMPTS) {
+    ERROR("IAS task given up after %d attempts", task.attempts);
+  } else if (!take_retry()) {
+    exhausted_count += 1;
+    ERROR("IAS retry budget exhausted");
+  } else if (!breaker.allow()) {
+    ERROR("IAS unavailable, task failed fast");
+  } else {
+    retry_count += 1;
+    send_task(std::move(task));
+    return;
+  }
+  executor_ias_callback(std::move(task.p_executor), "");
 }
 
-IAS::IAS() : stream(ctx, ssl_ctx) {}
+// 将任务放入队列并唤醒一个 IAS
+void IAS::send_task(Task&& task) {
+  if (!tasks.push(std::move(task))) {
+    // 每个 Executor 至多一个任务，不应出现
+    ERROR("IAS task queue full");
+    executor_ias_callback(std::move(task.p_executor), "");
+    return;
+  }
+  INFO("IAS task added");
+  // 没有等待中的 IAS 时所有 IAS 都在工作，完成后会取出该任务
+  wake_one();
+}
+
+// 唤醒一个等待中的 IAS
+// idle 已被清除的 index 是再检查时取到任务的 IAS 留下的，跳过并继续取
+void IAS::wake_one() {
+  int index;
+  while (idle_ias.pop(index)) {
+    auto& ias = ias_pool[index];
+    ias.queued = false;
+    if (ias.idle.exchange(false)) {
+      post(ias.io_strand, [&ias]() { ias.wake.cancel(); });
+      return;
+    }
+  }
+}
 
 // 发送 IAS，会调用 Executor 中的回调函数
 void IAS::send_ias(boost::shared_ptr<Executor> p_executor,
-                   const std::string& request) {
+                   std::string&& request, std::string&& key) {
   initialize_context();
-  // 将任务加入队列
-  INFO("IAS task added");
-  // 如果有空闲 IAS，则将其激活
-
-  // 加锁找空闲 IAS
-  task_mutex.lock();
-  tasks.push_back(std::make_tuple(p_executor, request));
-  if (!idle_ias.empty()) {
-    int index = idle_ias.front();
-    idle_ias.pop_front();
-    task_mutex.unlock();
-    spawn_ias(index);
-  } else {
-    task_mutex.unlock();
+  deposit_retry();
+  if (!breaker.allow()) {
+    // IAS 不可用，直接失败，不再排队等待
+    executor_ias_callback(std::move(p_executor), "");
+    return;
   }
+  Task task;
+  task.p_executor = std::move(p_executor);
+  task.request = std::move(request);
+  task.key = std::move(key);
+  send_task(std::move(task));
 }
 
-void send_ias(boost::shared_ptr<Executor> p_executor,
-              const std::string& request) {
-  IAS::send_ias(p_executor, request);
+void send_ias(boost::shared_ptr<Executor> p_executor, std::string&& request,
+              std::string&& key) {
+  IAS::send_ias(std::move(p_executor), std::move(request), std::move(key));
 }
+
+bool find_ias_report(const std::string& key, std::string& report,
+                     bool& verified) {
+  return IAS::find_report(key, report, verified);
+}
+
+size_t ias_avoided_calls() { return IAS::avoided_calls; }
+
+std::string ias_metrics() { return IAS::metrics(); }
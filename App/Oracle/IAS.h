@@ -7,12 +7,20 @@
 #include <boost/beast.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread/mutex.hpp>
-#include <list>
-#include <tuple>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <unordered_map>
+#include <optional>
+#include <string>
+#include "CircuitBreaker.h"
+#include "IasVerifier.h"
+#include "MpmcQueue.h"
 #include "Shared/Config.h"
 
 using namespace boost::asio;
 using namespace boost::beast;
+using namespace std::chrono;
 class Executor;
 
 class IAS {
@@ -21,31 +29,118 @@ class IAS {
 
   int index;
 
+  // 由 IAS_THREADS 个线程运行
   static io_context ctx;
+  // 该 IAS 的协程和连接上的所有操作都在这里依次执行
+  strand<io_context::executor_type> io_strand;
   ip::tcp::resolver::results_type endpoints;
-  ssl::stream<tcp_stream> stream;
+  // 每次连接时重新创建，失败过的 SSL 对象不能再次握手
+  std::optional<ssl::stream<tcp_stream>> stream;
+  // 没有任务时在此等待（永不到期），send_task 取消等待以唤醒
+  steady_timer wake;
+  // 正在等待 wake，send_task 唤醒或再检查取到任务时清除
+  std::atomic<bool> idle = false;
+  // index 在 idle_ias 中，被 send_task 取出时清除；再检查取到任务时 index
+  // 留在 idle_ias 中（idle 已清除），下次等待时直接沿用
+  std::atomic<bool> queued = false;
 
-  bool tcp_connected = false;
   bool ssl_connected = false;
+  // 该连接连续失败的次数，决定重连前的退避时间
+  int failures = 0;
 
-  // 等待进行 IAS 的任务
-  static std::list<std::tuple<boost::shared_ptr<Executor>, std::string>> tasks;
-  static boost::mutex task_mutex;
-  // IAS 池，每个 IAS 对应一个 SSL 连接
+  // 一个 IAS 任务：Executor、请求和 quote 在缓存中的 key，只能移动
+  struct Task {
+    boost::shared_ptr<Executor> p_executor;
+    std::string request;
+    std::string key;
+    // 已经尝试的次数
+    int attempts = 0;
+
+    Task() = default;
+    Task(Task&&) = default;
+    Task& operator=(Task&&) = default;
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+  };
+  // 等待进行 IAS 的任务，每个 Executor 同时至多有一个
+  static MpmcQueue<Task, 2 * MAX_WORKER> tasks;
+  // 等待任务的 IAS 的 index，每个 IAS 至多出现一次
+  static MpmcQueue<int, next_power_of_2(IAS_POOL_SIZE)> idle_ias;
+  // IAS 池，每个 IAS 对应一个 SSL 连接，在 initialize_context 中全部启动，
+  // 之后一直存在
   static IAS ias_pool[IAS_POOL_SIZE];
-  static std::list<int> idle_ias;
+
+  // 缓存的一个 IAS 回复
+  struct CachedReport {
+    time_point<steady_clock> time;
+    std::string report;
+    // 签名和证书链是否验证通过
+    bool verified;
+  };
+  // 成功的 IAS 回复，以 quote body（不含随机化的签名）的 SHA-256 为 key
+  static std::unordered_map<std::string, CachedReport> reports;
+  // reports 中的 key，按加入的顺序，超出 IAS_CACHE_SIZE 时淘汰最早的
+  static std::deque<std::string> report_order;
+  static boost::mutex report_mutex;
+
+  // IAS 的健康状态，所有连接共用
+  static CircuitBreaker breaker;
+  // 重试预算，以百分之一次重试为单位
+  static std::atomic<int> retry_tokens;
+  // 发出的请求数、失败数、重试数和因预算不足而放弃的重试数
+  static std::atomic<size_t> request_count;
+  static std::atomic<size_t> failure_count;
+  static std::atomic<size_t> retry_count;
+  static std::atomic<size_t> exhausted_count;
+  // 未通过签名验证的成功回复数
+  static std::atomic<size_t> unverified_count;
+
+  // 验证回复的签名，每个回复只验证一次，结果随回复一起缓存
+  static IasVerifier verifier;
+
+  // 新任务存入重试预算
+  static void deposit_retry();
+  // 从重试预算中取出一次重试，不足时返回 false
+  static bool take_retry();
+  // 任务失败，允许时重新放入队列，否则以失败结束
+  static void retry_or_fail(Task&& task);
+
+  // 关闭连接，连续失败时按指数退避等待后返回
+  void reset(yield_context yield);
+  // 建立 TCP 和 SSL 连接，失败时退避后重试，直到成功
+  void connect(yield_context yield);
+
+  // 加入一个 IAS 回复
+  static void save_report(const std::string& key, const std::string& report,
+                          bool verified);
 
   // 初始化全局变量和 IAS 池
   static void initialize_context();
   // 执行的主流程
   void async_process(yield_context yield);
-  // 激活某个 IAS
-  static void spawn_ias(int index);
+  // 取出一个任务，队列为空时加入 idle_ias 并等待 wake
+  void wait_task(Task& task, yield_context yield);
+  // 唤醒一个等待中的 IAS
+  static void wake_one();
 
  public:
-  // 发送 IAS，会调用 Executor 中的回调函数
+  // 因缓存命中而省去的 IAS 请求数
+  static std::atomic<size_t> avoided_calls;
+
+  // 各项统计和熔断器的状态，用于日志
+  static std::string metrics();
+
+  // 查找 IAS_CACHE_TTL 内得到的回复，命中时写入 report 和是否通过验证，
+  // 并返回 true
+  static bool find_report(const std::string& key, std::string& report,
+                          bool& verified);
+
+  // 发送 IAS，会调用 Executor 中的回调函数，成功的回复以 key 缓存
   static void send_ias(boost::shared_ptr<Executor> p_executor,
-                       const std::string& request);
+                       std::string&& request, std::string&& key);
+
+  // 将任务放入队列并唤醒一个 IAS
+  static void send_task(Task&& task);
 };
 
 #endif  // _A_IAS_H_
\ No newline at end of file
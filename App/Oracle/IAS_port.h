@@ -1,10 +1,24 @@
 #ifndef _A_IAS_PORT_H_
 #define _A_IAS_PORT_H_
 
+#include <stddef.h>
 #include <boost/shared_ptr.hpp>
+#include <string>
 class Executor;
 
-void send_ias(boost::shared_ptr<Executor> p_executor,
-              const std::string& request);
+// 发送 IAS 请求，请求直接移入任务队列，成功的回复以 key 缓存
+void send_ias(boost::shared_ptr<Executor> p_executor, std::string&& request,
+              std::string&& key);
+
+// 查找以 key 缓存的 IAS 回复，命中时写入 report 和是否通过签名验证，
+// 并返回 true
+bool find_ias_report(const std::string& key, std::string& report,
+                     bool& verified);
+
+// 因缓存命中而省去的 IAS 请求数
+size_t ias_avoided_calls();
+
+// IAS 的请求、失败、重试和熔断统计，用于日志
+std::string ias_metrics();
 
 #endif  // _A_IAS_PORT_H_
\ No newline at end of file
@@ -1,4 +1,5 @@
-// send 和 recv 的 ocall
+// send、recv、流式结果和 HTTP/2 stream 唤醒的 ocall
+// 可由多个 Enclave 线程同时调用：不使用静态缓冲区，也不访问 Oracle::executors
 #include "Oracle.h"
 
 void wait(boost::shared_ptr<Executor> p_executor,
@@ -20,20 +21,22 @@ void wait(boost::shared_ptr<Executor> p_executor,
 
 // 需要符合 Linux socket IO 的接口，按照标准设置 errno
 int o_recv(int socket_id, char **p_buffer, int size, int *p_errno) {
-  static char buffer[SOCKET_READ_SIZE];
   // 找到对应的 socket
-  auto iter = Oracle::global().executors.find(socket_id);
-  if (iter == Oracle::global().executors.cend()) {
+  auto p_executor = Oracle::global().find_executor(socket_id);
+  if (p_executor == nullptr) {
     ERROR("No socket with id %d", socket_id);
     *p_errno = ENOTSOCK;
     return -1;
   }
-  auto &executor = *iter->second;
+  auto &executor = *p_executor;
   auto &socket = executor.socket;
+  // 读入该连接独占的缓冲区
+  auto &buffer = executor.recv_buffer;
   // 调用非阻塞 IO
   boost::system::error_code error;
   auto recv_size = socket.receive(
-      mutable_buffer(buffer, std::min(SOCKET_READ_SIZE, size)), 0, error);
+      mutable_buffer(buffer, std::min(SOCKET_RECV_BUFFER_SIZE, size)), 0,
+      error);
   if (!error) {
     // 成功读取数据，则返回数据
     INFO("o_recv() get %lu bytes (%s, %d)", recv_size,
@@ -60,13 +63,13 @@ int o_recv(int socket_id, char **p_buffer, int size, int *p_errno) {
 
 int o_send(int socket_id, const char *buffer, int size, int *p_errno) {
   // 找到对应的 socket
-  auto iter = Oracle::global().executors.find(socket_id);
-  if (iter == Oracle::global().executors.cend()) {
+  auto p_executor = Oracle::global().find_executor(socket_id);
+  if (p_executor == nullptr) {
     ERROR("No socket with id %d", socket_id);
     *p_errno = ENOTSOCK;
     return -1;
   }
-  auto &executor = *iter->second;
+  auto &executor = *p_executor;
   auto &socket = executor.socket;
   boost::system::error_code error;
   // 调用非阻塞 IO
@@ -92,4 +95,28 @@ int o_send(int socket_id, const char *buffer, int size, int *p_errno) {
     return -1;
   }
   UNREACHABLE();
-}
\ No newline at end of file
+}
+
+// 流式模式下 Enclave 交出一段已解密的响应，在 e_work 期间调用
+void o_stream(int id, const char *data, size_t size) {
+  auto p_executor = Oracle::global().find_executor(id);
+  if (p_executor == nullptr || !p_executor->on_chunk) {
+    ERROR("No streaming executor with id %d", id);
+    return;
+  }
+  INFO("o_stream() got %lu bytes", size);
+  p_executor->on_chunk(data, size);
+}
+
+// HTTP/2 连接上的某个 stream 已经结束，在连接的 e_work 期间调用
+// 该 stream 可能已经超时被移除，或者尚未开始等待
+void o_ready(int id) {
+  auto p_executor = Oracle::global().find_executor(id);
+  if (p_executor == nullptr) {
+    INFO("o_ready() for removed executor %d", id);
+    return;
+  }
+  if (p_executor->blocking.exchange(false)) {
+    Oracle::global().need_work(p_executor->shared_from_this());
+  }
+}
@@ -0,0 +1,153 @@
+#include "IasVerifier.h"
+#include <ctype.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <boost/thread/lock_guard.hpp>
+#include "App/deps/base64.h"
+#include "App/deps/json.hpp"
+#include "Shared/Config.h"
+#include "Shared/Logging.h"
+#include "Shared/deps/sha256.h"
+
+using json = nlohmann::json;
+
+// 回复头中的证书链经过 URL 编码
+static std::string url_decode(const std::string& text) {
+  std::string decoded;
+  decoded.reserve(text.size());
+  for (size_t i = 0; i < text.size(); i += 1) {
+    if (text[i] == '%' && i + 2 < text.size() &&
+        isxdigit((unsigned char)text[i + 1]) &&
+        isxdigit((unsigned char)text[i + 2])) {
+      decoded += (char)std::stoi(text.substr(i + 1, 2), nullptr, 16);
+      i += 2;
+    } else {
+      decoded += text[i];
+    }
+  }
+  return decoded;
+}
+
+IasVerifier::~IasVerifier() {
+  if (store != nullptr) {
+    X509_STORE_free(store);
+  }
+}
+
+// 从 PEM 文件加载根证书，在 verify 之前调用一次
+bool IasVerifier::load_root(const char* path) {
+  store = X509_STORE_new();
+  if (X509_STORE_load_locations(store, path, nullptr) != 1) {
+    ERROR("Failed to load IAS root certificate %s, IAS reports will not be "
+          "verified",
+          path);
+    X509_STORE_free(store);
+    store = nullptr;
+    return false;
+  }
+  return true;
+}
+
+// 取得证书链中签名证书的公钥，证书链无效时返回空指针
+std::shared_ptr<EVP_PKEY> IasVerifier::get_key(
+    const std::string& certificates) {
+  {
+    boost::lock_guard lock(mutex);
+    if (certificates == cached_certificates) {
+      return cached_key;
+    }
+  }
+  if (store == nullptr) {
+    return nullptr;
+  }
+  // 第一个证书是签名证书，其余作为不受信任的中间证书参与验证
+  auto pem = url_decode(certificates);
+  auto bio = BIO_new_mem_buf(pem.data(), (int)pem.size());
+  auto chain = sk_X509_new_null();
+  while (auto cert = PEM_read_bio_X509(bio, nullptr, nullptr, nullptr)) {
+    sk_X509_push(chain, cert);
+  }
+  // 读到结尾时 PEM 会留下错误，不影响之后的操作
+  ERR_clear_error();
+  BIO_free(bio);
+  std::shared_ptr<EVP_PKEY> key;
+  if (sk_X509_num(chain) > 0) {
+    auto leaf = sk_X509_value(chain, 0);
+    auto ctx = X509_STORE_CTX_new();
+    if (X509_STORE_CTX_init(ctx, store, leaf, chain) == 1 &&
+        X509_verify_cert(ctx) == 1) {
+      key.reset(X509_get_pubkey(leaf), EVP_PKEY_free);
+    } else {
+      ERROR("IAS signing certificate rejected: %s",
+            X509_verify_cert_error_string(X509_STORE_CTX_get_error(ctx)));
+    }
+    X509_STORE_CTX_free(ctx);
+  }
+  sk_X509_pop_free(chain, X509_free);
+  if (key) {
+    boost::lock_guard lock(mutex);
+    cached_certificates = certificates;
+    cached_key = key;
+  }
+  return key;
+}
+
+// 验证一个 IAS 回复，key 为发出的 quote body 的 SHA-256（十六进制）
+bool IasVerifier::verify(const std::string& body, const std::string& signature,
+                         const std::string& certificates,
+                         const std::string& key) {
+  auto public_key = get_key(certificates);
+  if (!public_key) {
+    return false;
+  }
+  // 验证签名
+  std::string raw_signature(
+      base64_decoded_size(signature.data(), signature.size()), '\0');
+  raw_signature.resize(base64_decode(signature.data(), signature.size(),
+                                     (unsigned char*)&raw_signature[0]));
+  auto md_ctx = EVP_MD_CTX_new();
+  auto valid =
+      EVP_DigestVerifyInit(md_ctx, nullptr, EVP_sha256(), nullptr,
+                           public_key.get()) == 1 &&
+      EVP_DigestVerify(md_ctx, (const unsigned char*)raw_signature.data(),
+                       raw_signature.size(), (const unsigned char*)body.data(),
+                       body.size()) == 1;
+  EVP_MD_CTX_free(md_ctx);
+  if (!valid) {
+    ERR_clear_error();
+    ERROR("IAS report signature is invalid");
+    return false;
+  }
+  // 只保留 isvEnclaveQuoteBody 和 isvEnclaveQuoteStatus，其余字段解析后
+  // 直接丢弃
+  auto parsed = json::parse(
+      body,
+      [](int depth, json::parse_event_t event, json& value) {
+        return depth != 1 || event != json::parse_event_t::key ||
+               value == "isvEnclaveQuoteBody" ||
+               value == "isvEnclaveQuoteStatus";
+      },
+      false);
+  if (!parsed.is_object() || !parsed.contains("isvEnclaveQuoteBody") ||
+      !parsed["isvEnclaveQuoteBody"].is_string() ||
+      !parsed.contains("isvEnclaveQuoteStatus") ||
+      !parsed["isvEnclaveQuoteStatus"].is_string()) {
+    ERROR("IAS report has no quote body or status");
+    return false;
+  }
+  // 签名的报告须针对发出的 quote
+  auto& quote_body = parsed["isvEnclaveQuoteBody"].get_ref<std::string&>();
+  if (sha256(base64_decode(quote_body)) != key) {
+    ERROR("IAS report is for a different quote");
+    return false;
+  }
+  // IAS 对 quote 的判定须可以接受
+  auto& status = parsed["isvEnclaveQuoteStatus"].get_ref<std::string&>();
+  for (auto accepted : IAS_ACCEPTED_QUOTE_STATUS) {
+    if (status == accepted) {
+      return true;
+    }
+  }
+  ERROR("IAS report has quote status %s", status.c_str());
+  return false;
+}
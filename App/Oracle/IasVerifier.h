@@ -0,0 +1,42 @@
+#ifndef _A_IASVERIFIER_H_
+#define _A_IASVERIFIER_H_
+
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+#include <boost/thread/mutex.hpp>
+#include <memory>
+#include <string>
+
+// 验证 IAS 回复：X-IASReport-Signing-Certificate 中的证书链以本地的根证书
+// 验证，X-IASReport-Signature 是签名证书对回复 body 的 RSA-SHA256 签名，
+// body 中的 isvEnclaveQuoteBody 须与发出的 quote 一致，isvEnclaveQuoteStatus
+// 须在 IAS_ACCEPTED_QUOTE_STATUS 中
+// 各回复的证书链通常相同，验证通过的证书链和其中的公钥会被缓存，之后每个
+// 回复只需验证一次签名；可在多个线程中同时调用
+class IasVerifier {
+ protected:
+  // 信任的根证书，load_root 失败时为空，所有回复都不能通过验证
+  X509_STORE* store = nullptr;
+  boost::mutex mutex;
+  // 上次验证通过的证书链（回复头中的原文）和其中签名证书的公钥
+  std::string cached_certificates;
+  std::shared_ptr<EVP_PKEY> cached_key;
+
+  // 取得证书链中签名证书的公钥，证书链无效时返回空指针
+  std::shared_ptr<EVP_PKEY> get_key(const std::string& certificates);
+
+ public:
+  IasVerifier() = default;
+  IasVerifier(const IasVerifier&) = delete;
+  IasVerifier& operator=(const IasVerifier&) = delete;
+  ~IasVerifier();
+
+  // 从 PEM 文件加载根证书，在 verify 之前调用一次
+  bool load_root(const char* path);
+
+  // 验证一个 IAS 回复，key 为发出的 quote body 的 SHA-256（十六进制）
+  bool verify(const std::string& body, const std::string& signature,
+              const std::string& certificates, const std::string& key);
+};
+
+#endif  // _A_IASVERIFIER_H_
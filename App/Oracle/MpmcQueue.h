@@ -0,0 +1,90 @@
+#ifndef _A_MPMCQUEUE_H_
+#define _A_MPMCQUEUE_H_
+
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+#include <utility>
+
+// 不小于 n 的最小的 2 的幂，用于确定队列容量
+constexpr size_t next_power_of_2(size_t n) {
+  return n <= 1 ? 1 : 2 * next_power_of_2((n + 1) / 2);
+}
+
+// 有界的无锁多生产者多消费者队列（Dmitry Vyukov 的算法）
+// 元素以移动方式放入和取出，T 需要可默认构造和移动赋值
+// Capacity 须为 2 的幂
+template <typename T, size_t Capacity>
+class MpmcQueue {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of 2");
+
+ protected:
+  struct Cell {
+    // 等于位置时可以写入，等于位置加一时可以读取
+    std::atomic<size_t> sequence;
+    T data;
+  };
+  // 生产者和消费者的位置分别在不同的 cache line 上，避免互相干扰
+  alignas(64) std::atomic<size_t> enqueue_pos{0};
+  alignas(64) std::atomic<size_t> dequeue_pos{0};
+  alignas(64) std::unique_ptr<Cell[]> cells;
+
+ public:
+  MpmcQueue() : cells(new Cell[Capacity]) {
+    for (size_t i = 0; i < Capacity; i += 1) {
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  MpmcQueue(const MpmcQueue &) = delete;
+  MpmcQueue &operator=(const MpmcQueue &) = delete;
+
+  // 放入一个元素，队列已满时返回 false，value 保持不变
+  bool push(T &&value) {
+    auto pos = enqueue_pos.load(std::memory_order_relaxed);
+    while (true) {
+      auto &cell = cells[pos & (Capacity - 1)];
+      auto sequence = cell.sequence.load(std::memory_order_acquire);
+      auto diff = (ptrdiff_t)sequence - (ptrdiff_t)pos;
+      if (diff == 0) {
+        if (enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed)) {
+          cell.data = std::move(value);
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // 取出一个元素，队列为空时返回 false
+  bool pop(T &value) {
+    auto pos = dequeue_pos.load(std::memory_order_relaxed);
+    while (true) {
+      auto &cell = cells[pos & (Capacity - 1)];
+      auto sequence = cell.sequence.load(std::memory_order_acquire);
+      auto diff = (ptrdiff_t)sequence - (ptrdiff_t)(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed)) {
+          value = std::move(cell.data);
+          // 移走后留下空对象，不再持有资源
+          cell.data = T();
+          cell.sequence.store(pos + Capacity, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = dequeue_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+};
+
+#endif  // _A_MPMCQUEUE_H_
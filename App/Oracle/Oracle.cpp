@@ -2,6 +2,7 @@
 #include <boost/thread.hpp>
 #include <chrono>
 #include "App/Enclave_u.h"
+#include "IAS_port.h"
 #include "Oracle_port.h"
 #include "Shared/Config.h"
 #include "Shared/StatusCode.h"
@@ -19,25 +20,36 @@ const std::string request =
     // "Accept: "
     // "text/html,application/xhtml+xml,application/xml;q=0.9,image/webp,image/"
     // "apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.9\r\n"
-    "Accept-Encoding: identity\r\n\r\n";
+    "Accept-Encoding: gzip, deflate\r\n\r\n";
 
 int completed = 0;
+// 进程启动的时间，用于统计从启动到第一个结果的延迟
+const auto process_start_time = steady_clock::now();
 
 void test() { Oracle::global().test_run("www.baidu.com", request); }
 
+void stress(const std::string &host) {
+  auto stress_request = "GET / HTTP/1.1\r\nHost: " + host +
+                        "\r\nAccept-Encoding: gzip, deflate\r\n\r\n";
+  Oracle::global().test_run(host, stress_request, MAX_WORKER, true);
+}
+
 // 获取唯一的 id
-int Oracle::get_random_id() {
+int Oracle::get_random_id(const sgx_enclave_id_t *p_eid) {
   static std::random_device rd;
   static std::mt19937 mt(rd());
   // 超出数量则抛出错误
   if (executors.size() >= MAX_WORKER) {
     throw StatusCode(StatusCode::NoAvailableWorker);
   }
-  // 获取唯一随机非负整数 id
+  // 获取唯一随机非负整数 id，其对应的 slot 必须空闲
   int new_id;
   do {
     new_id = abs(static_cast<int>(mt()));
-  } while (executors.find(new_id) != executors.cend());
+  } while (slots[new_id % MAX_WORKER].load(std::memory_order_relaxed) !=
+               nullptr ||
+           followers.count(new_id) || cached_results.count(new_id) ||
+           (p_eid != nullptr && enclave_of(new_id) != *p_eid));
   return new_id;
 }
 
@@ -47,19 +59,246 @@ std::map<int, boost::shared_ptr<Executor>>::iterator Oracle::remove_job(
   if (it == executors.cend()) {
     return it;
   }
+  // 先清空 slot，之后 o_recv 和 o_send 将无法找到该 Executor
+  slots[it->first % MAX_WORKER].store(nullptr, std::memory_order_release);
+  // 失败的任务不交出结果，合并到其上的任务同样结束
+  for (auto follower : take_followers(it->first)) {
+    ERROR("Coalesced job %d terminated with executor %d", follower,
+          it->first);
+  }
+  // 维护 HTTP/2 连接的 stream 计数，移除的连接不再分配新的 stream
+  auto &executor = *it->second;
+  if (executor.kind == Executor::Stream) {
+    auto count = connection_streams.find(executor.connection_id);
+    if (count != connection_streams.end()) {
+      count->second -= 1;
+    }
+  } else if (executor.kind == Executor::Connection) {
+    connection_streams.erase(it->first);
+    auto key = std::make_pair(executor.eid, executor.get_hostname());
+    auto found = connections.find(key);
+    if (found != connections.end() && found->second == it->first) {
+      connections.erase(found);
+    }
+  }
   // 在 Enclave 中移除
-  e_remove_ssl(global_eid, it->first);
+  e_remove_ssl(it->second->eid, it->first);
   // 移除并返回 iterator
   return executors.erase(it);
 }
 
-// 创建一个新的任务
-void Oracle::new_job(const std::string &address, const std::string &request) {
+// 创建一个新的任务，返回其 id，对应 Enclave 的内存达到
+// ENCLAVE_MEMORY_ADMIT 时不创建并返回 -1
+int Oracle::new_job(const std::string &address, const std::string &request,
+                    StreamHandler on_chunk, steady_clock::duration max_age) {
+  std::string key;
+  if (!on_chunk) {
+    // 主机名中不含 '\n'，两者拼接后不会混淆
+    key = address + '\n' + request;
+    EnclaveResult cached;
+    if (max_age > steady_clock::duration::zero() &&
+        result_cache.find(key, max_age, cached)) {
+      auto id = get_random_id();
+      cached_results.emplace(id, std::move(cached));
+      requested_jobs += 1;
+      LOG("Job %d satisfied by cached result", id);
+      return id;
+    }
+    auto found = coalescing.find(key);
+    if (found != coalescing.end() &&
+        steady_clock::now() - found->second.start_time < COALESCE_WINDOW) {
+      auto id = get_random_id();
+      followers_of[found->second.id].push_back(id);
+      followers.insert(id);
+      requested_jobs += 1;
+      coalesced_jobs += 1;
+      LOG("Job %d coalesced into executor %d", id, found->second.id);
+      return id;
+    }
+  }
   auto id = get_random_id();
-  auto shared_p =
-      boost::shared_ptr<Executor>(new Executor(ctx, id, address, request));
-  executors.emplace(id, shared_p);
-  pending.push_back(std::move(shared_p));
+  auto eid = enclave_of(id);
+  auto &usage = memory_usage[eid];
+  if (usage >= (size_t)ENCLAVE_MEMORY_ADMIT) {
+    return -1;
+  }
+  boost::shared_ptr<Executor> shared_p;
+  if (USE_HTTP2 && !on_chunk) {
+    // stream 不占用 WolfSSL 对象，接收缓冲区也只在连接中分配
+    auto connection_id = get_connection(eid, address);
+    connection_streams[connection_id] += 1;
+    // 新建的连接可能占用了 id 对应的 slot，在同一 Enclave 中重新选取
+    id = get_random_id(&eid);
+    shared_p = boost::shared_ptr<Executor>(
+        new Executor(ctx, id, eid, address, request, nullptr,
+                     Executor::Stream, connection_id));
+  } else {
+    // 下次更新前，按新连接的大致占用累加，避免一轮中创建过多任务
+    usage += SOCKET_RECV_BUFFER_SIZE + SSL_MEMORY_ESTIMATE;
+    shared_p = boost::shared_ptr<Executor>(
+        new Executor(ctx, id, eid, address, request, std::move(on_chunk)));
+  }
+  add_executor(std::move(shared_p));
+  if (!key.empty()) {
+    // 窗口已过的旧任务继续执行，之后的相同请求合并到新任务上
+    coalescing[key] = {id, steady_clock::now()};
+    coalescing_keys[id] = std::move(key);
+  }
+  requested_jobs += 1;
+  return id;
+}
+
+// 任务结束时移出 coalescing，返回共用其结果的任务 id
+std::vector<int> Oracle::take_followers(int id) {
+  std::vector<int> result;
+  auto key = coalescing_keys.find(id);
+  if (key == coalescing_keys.end()) {
+    return result;
+  }
+  // 被更新的任务替换后，key 已经指向其他任务
+  auto found = coalescing.find(key->second);
+  if (found != coalescing.end() && found->second.id == id) {
+    coalescing.erase(found);
+  }
+  coalescing_keys.erase(key);
+  auto list = followers_of.find(id);
+  if (list != followers_of.end()) {
+    result.swap(list->second);
+    followers_of.erase(list);
+  }
+  for (auto follower : result) {
+    followers.erase(follower);
+  }
+  return result;
+}
+
+// 返回该 Enclave 中到 hostname 的、未满 HTTP2_MAX_STREAMS 的连接，
+// 没有时新建一个
+int Oracle::get_connection(sgx_enclave_id_t eid,
+                           const std::string &hostname) {
+  auto key = std::make_pair(eid, hostname);
+  auto found = connections.find(key);
+  if (found != connections.end() &&
+      connection_streams[found->second] < HTTP2_MAX_STREAMS) {
+    return found->second;
+  }
+  // 已满的连接继续服务其上的 stream，直到对方关闭
+  auto id = get_random_id(&eid);
+  memory_usage[eid] += SOCKET_RECV_BUFFER_SIZE + SSL_MEMORY_ESTIMATE;
+  add_executor(boost::shared_ptr<Executor>(new Executor(
+      ctx, id, eid, hostname, "", nullptr, Executor::Connection)));
+  connections[key] = id;
+  connection_streams[id] = 0;
+  return id;
+}
+
+// 加入 executors 和 slots，并等待第一次 work
+void Oracle::add_executor(boost::shared_ptr<Executor> p_executor) {
+  auto id = p_executor->id;
+  executors.emplace(id, p_executor);
+  slots[id % MAX_WORKER].store(p_executor.get(), std::memory_order_release);
+  pending.push_back(std::move(p_executor));
+}
+
+// 检查每个 Executor 都能以 id 找到，且没有多余的 slot，返回是否一致
+bool Oracle::check_slots() const {
+  size_t used = 0;
+  for (auto &slot : slots) {
+    if (slot.load(std::memory_order_relaxed) != nullptr) {
+      used += 1;
+    }
+  }
+  if (used != executors.size()) {
+    ERROR("%lu slots used by %lu executors", (unsigned long)used,
+          (unsigned long)executors.size());
+    return false;
+  }
+  for (auto &pair : executors) {
+    if (find_executor(pair.first) != pair.second.get()) {
+      ERROR("Executor %d not found in its slot", pair.first);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Enclave 内存紧张，暂停该任务直到有内存释放
+void Oracle::throttle(boost::shared_ptr<Executor> p_executor) {
+  boost::lock_guard lock(mutex);
+  throttled.push_back(std::move(p_executor));
+}
+
+// 该 Enclave 中有任务等待生成 report
+void Oracle::request_quote(sgx_enclave_id_t eid) {
+  boost::lock_guard lock(mutex);
+  need_quote.insert(eid);
+}
+
+// 在各 Enclave 的线程中执行 executors 的 Executor::work，done 和 errors
+// 按下标记录完成与否和抛出的异常
+// Enclave 内的状态不是线程安全的，同一 Enclave 的任务只在一个线程中执行；
+// 不同 Enclave 的 e_work 及其中的 o_recv、o_send 同时进行
+void Oracle::work_in_parallel(const std::vector<Executor *> &executors,
+                              std::vector<char> &done,
+                              std::vector<std::exception_ptr> &errors) {
+  std::map<sgx_enclave_id_t, std::vector<size_t>> groups;
+  for (size_t i = 0; i < executors.size(); i++) {
+    groups[executors[i]->eid].push_back(i);
+  }
+  auto run = [&](const std::vector<size_t> &indices) {
+    for (auto i : indices) {
+      auto &executor = *executors[i];
+      // 其他线程中的 e_work 同时在查找 slots
+      if (find_executor(executor.id) != &executor) {
+        lookup_failures += 1;
+      }
+      try {
+        done[i] = executor.work();
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+      if (find_executor(executor.id) != &executor) {
+        lookup_failures += 1;
+      }
+    }
+  };
+  std::vector<boost::thread> threads;
+  for (auto &pair : groups) {
+    threads.emplace_back(run, boost::cref(pair.second));
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+// 更新 memory_usage，Enclave 的占用低于 ENCLAVE_MEMORY_PAUSE 时恢复其中
+// 暂停的任务，超时的任务交给 Executor::work 结束
+void Oracle::update_memory_usage() {
+  std::set<sgx_enclave_id_t> released;
+  for (auto eid : global_eids) {
+    size_t usage;
+    e_memory_usage(eid, &usage);
+    if (usage < (size_t)ENCLAVE_MEMORY_PAUSE) {
+      released.insert(eid);
+    }
+    memory_usage[eid] = usage;
+  }
+  auto now = steady_clock::now();
+  for (auto it = throttled.begin(); it != throttled.end();) {
+    auto &executor = **it;
+    if (released.count(executor.eid)) {
+      // 仍然超出的任务会在下次 e_work 时再次被暂停
+      executor.blocking = false;
+      need_work(std::move(*it));
+      it = throttled.erase(it);
+    } else if (now - executor.get_start_time() > TASK_TIMEOUT) {
+      // 保持 blocking，Executor::work 检查超时后抛出，在 work() 中移除
+      need_work(std::move(*it));
+      it = throttled.erase(it);
+    } else {
+      it++;
+    }
+  }
 }
 
 // 某个异步 IO 操作完成，需要执行 Executor::work
@@ -76,15 +315,61 @@ void Oracle::work() {
     boost::lock_guard lock(mutex);
     pending.swap(recorded_pending);
   }
+  // 交出由缓存满足的结果
+  for (auto &pair : cached_results) {
+    completed++;
+    if (on_result) {
+      on_result(pair.first, std::move(pair.second));
+    }
+  }
+  cached_results.clear();
+  // 并行时先在各 Enclave 的线程中执行所有 Executor::work
+  std::vector<char> done;
+  std::vector<std::exception_ptr> errors;
+  if (parallel_work) {
+    std::vector<Executor *> recorded;
+    for (auto &p_executor : recorded_pending) {
+      recorded.push_back(p_executor.get());
+    }
+    done.resize(recorded.size());
+    errors.resize(recorded.size());
+    work_in_parallel(recorded, done, errors);
+  }
   // 处理这些任务
+  size_t index = 0;
   for (auto it = recorded_pending.begin(); it != recorded_pending.cend();
-       it++) {
+       it++, index++) {
     auto &executor = **it;
     try {
-      if (executor.work()) {
+      if (parallel_work && errors[index]) {
+        std::rethrow_exception(errors[index]);
+      }
+      if (parallel_work ? (bool)done[index] : executor.work()) {
         // 该任务完成，将其释放
         LOG(GREEN "Executor %d completed, freeing" RESET, executor.id);
         completed++;
+        if (completed == 1) {
+          LOG("First result %ld ms after startup",
+              (long)duration_cast<milliseconds>(steady_clock::now() -
+                                                process_start_time)
+                  .count());
+        }
+        // 缓存结果，之后新鲜度要求允许的相同任务直接使用
+        auto key = coalescing_keys.find(executor.id);
+        if (key != coalescing_keys.end()) {
+          result_cache.insert(key->second, executor.get_start_time(),
+                              executor.peek_result());
+        }
+        // 合并到该任务上的任务各自得到一份结果
+        for (auto follower : take_followers(executor.id)) {
+          completed++;
+          if (on_result) {
+            on_result(follower, executor.peek_result().copy());
+          }
+        }
+        if (on_result) {
+          on_result(executor.id, executor.take_result());
+        }
         remove_job(executor.id);
       } else {
         if (!executor.blocking) {
@@ -98,12 +383,22 @@ void Oracle::work() {
       remove_job(executor.id);
     }
   }
+  // 为本轮中接收完响应的任务批量生成 report，下一轮 e_work 时取得结果
+  for (auto eid : need_quote) {
+    int quoted;
+    e_quote_batch(eid, &quoted);
+    LOG("%d reports created in batch by enclave %lu", quoted,
+        (unsigned long)eid);
+  }
+  need_quote.clear();
+  update_memory_usage();
 }
 
-void Oracle::test_run(const std::string &address, const std::string &request) {
+void Oracle::test_run(const std::string &address, const std::string &request,
+                      int concurrency, bool stress) {
   // 建立多个线程执行不需要 Enclave 参与的步骤，即 io_context::run()
   auto run = [&]() {
-    while (true) {
+    while (!stopping) {
       ctx.run();
       ctx.restart();
     }
@@ -112,18 +407,54 @@ void Oracle::test_run(const std::string &address, const std::string &request) {
   boost::thread bg1(run);
   boost::thread bg2(run);
   boost::thread check([&]() {
-    for (int i = 1;; i++) {
+    for (int i = 1; !stopping; i++) {
       sleep(1);
       dispatch(ctx, [i]() {
         LOG("Speed: %d/%d = %f", completed, i, (float)completed / i);
+        auto &oracle = Oracle::global();
+        LOG("Coalesced: %lu/%lu jobs", (unsigned long)oracle.coalesced_jobs,
+            (unsigned long)oracle.requested_jobs);
+        LOG("%s", ias_metrics().c_str());
+        LOG("Result cache: %lu hits, %lu misses",
+            (unsigned long)oracle.result_cache.hits,
+            (unsigned long)oracle.result_cache.misses);
       });
     }
   });
-  while (true) {
-    if (executors.size() < 128) {
-      new_job(address, request);
+  size_t jobs = 0, rounds = 0, inconsistent = 0;
+  parallel_work = stress;
+  while (!stopping) {
+    if (executors.size() + followers.size() < (size_t)concurrency) {
+      if (stress) {
+        // 在路径后加入序号，每个任务使用各自的连接
+        auto job_request = request;
+        job_request.insert(job_request.find(' ') + 2,
+                           "?stress=" + std::to_string(jobs++));
+        new_job(address, job_request);
+      } else {
+        new_job(address, request);
+      }
     }
     work();
+    if (stress) {
+      rounds += 1;
+      if (!check_slots()) {
+        inconsistent += 1;
+      }
+    }
+  }
+  // 停止后台线程，剩余的任务随进程一起结束，由调用者保存快照
+  ctx.stop();
+  bg0.join();
+  bg1.join();
+  bg2.join();
+  check.join();
+  LOG("Stopped with %d results", completed);
+  if (stress) {
+    LOG("Slots inconsistent in %lu of %lu rounds, %lu failed lookups in "
+        "enclave threads",
+        (unsigned long)inconsistent, (unsigned long)rounds,
+        (unsigned long)lookup_failures);
   }
 }
 
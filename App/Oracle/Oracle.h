@@ -2,16 +2,23 @@
 #define _A_ORACLE_H_
 
 #include <errno.h>
+#include <atomic>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread/mutex.hpp>
+#include <exception>
+#include <functional>
 #include <iostream>
 #include <list>
 #include <random>
+#include <set>
+#include <unordered_map>
+#include <vector>
 #include "App/App.h"
 #include "App/Enclave_u.h"
 #include "Executor.h"
+#include "ResultCache.h"
 #include "Shared/Config.h"
 #include "Shared/Logging.h"
 #include "sgx_urts.h"
@@ -19,26 +26,123 @@
 using namespace boost::asio;
 
 void test();
+// 并发连接的压力测试，在模拟模式（SGX_MODE=SIM）下运行：对 host 维持
+// MAX_WORKER 个各自独立的连接，各 Enclave 的 e_work 在各自的线程中同时执行，
+// 每轮 work 后检查 slots 与 executors 是否一致
+void stress(const std::string &host);
 
 class Oracle {
  protected:
   // 单件
   Oracle() = default;
 
-  // 获取唯一的 id
-  int get_random_id();
+  // 获取唯一的 id，给出 eid 时只返回分配到该 Enclave 的 id
+  // 不会与正在执行的任务或等待合并结果的任务重复
+  int get_random_id(const sgx_enclave_id_t *p_eid = nullptr);
 
   // 从 map 中和 Enclave 中移除一个任务
   void remove_job(int id) { remove_job(executors.find(id)); }
   std::map<int, boost::shared_ptr<Executor>>::iterator remove_job(
       const std::map<int, boost::shared_ptr<Executor>>::iterator &it);
 
+  // 每组主机和请求最近创建的非流式任务，以两者拼接为 key
+  struct Coalescing {
+    int id;
+    time_point<steady_clock> start_time;
+  };
+  std::unordered_map<std::string, Coalescing> coalescing;
+  // 非流式任务 id 到其在 coalescing 中的 key
+  std::map<int, std::string> coalescing_keys;
+  // 执行中的任务 id 到共用其结果的任务 id，后者没有对应的 Executor
+  std::map<int, std::vector<int>> followers_of;
+  // 所有等待合并结果的任务 id
+  std::set<int> followers;
+  // 由 result_cache 满足、下一轮 work() 开始时交出的结果
+  std::map<int, EnclaveResult> cached_results;
+
+  // 任务结束时移出 coalescing，返回共用其结果的任务 id
+  std::vector<int> take_followers(int id);
+
   std::list<boost::shared_ptr<Executor>> pending;
   boost::mutex mutex;
 
+  // 因 Enclave 内存紧张而暂停读取的任务，throttle 时加锁，其余仅在主线程
+  // 中访问
+  std::list<boost::shared_ptr<Executor>> throttled;
+  // 各 Enclave 中缓冲的字节数，每轮 work() 结束时通过 e_memory_usage 更新，
+  // 两次更新之间创建的任务按预估值累加
+  std::map<sgx_enclave_id_t, size_t> memory_usage;
+
+  // 更新 memory_usage，Enclave 的占用低于 ENCLAVE_MEMORY_PAUSE 时恢复其中
+  // 暂停的任务，超时的任务交给 Executor::work 结束
+  void update_memory_usage();
+
+  // 每个 Enclave 中每个主机可以挂载新 stream 的 HTTP/2 连接的 id
+  std::map<std::pair<sgx_enclave_id_t, std::string>, int> connections;
+  // 各 HTTP/2 连接上尚未移除的 stream 数量
+  std::map<int, int> connection_streams;
+
+  // 返回该 Enclave 中到 hostname 的、未满 HTTP2_MAX_STREAMS 的连接，
+  // 没有时新建一个
+  int get_connection(sgx_enclave_id_t eid, const std::string &hostname);
+
+  // 加入 executors 和 slots，并等待第一次 work
+  void add_executor(boost::shared_ptr<Executor> p_executor);
+
+  // 检查每个 Executor 都能以 id 找到，且没有多余的 slot，返回是否一致
+  bool check_slots() const;
+
+  // 按 id % MAX_WORKER 索引的 Executor，供 o_recv 和 o_send 无锁查找
+  // 仅在主线程的 new_job 和 remove_job 中修改
+  std::atomic<Executor *> slots[MAX_WORKER] = {};
+
+  // 为 true 时 work() 中各 Enclave 的任务在各自的线程中执行 Executor::work，
+  // 同一 Enclave 的任务仍在同一线程中依次执行；完成和出错的处理在之后的
+  // 主线程中进行。流式任务的 on_chunk 会在这些线程中被调用
+  bool parallel_work = false;
+  // 并行执行时，Executor::work 前后以 find_executor 找不到自身的次数
+  std::atomic<size_t> lookup_failures = 0;
+
+  // 在各 Enclave 的线程中执行 executors 的 Executor::work，done 和 errors
+  // 按下标记录完成与否和抛出的异常
+  void work_in_parallel(const std::vector<Executor *> &executors,
+                        std::vector<char> &done,
+                        std::vector<std::exception_ptr> &errors);
+
  public:
   io_context ctx;
   std::map<int, boost::shared_ptr<Executor>> executors;
+  // 任务完成时接收结果，结果以移动方式交出，不复制数据
+  std::function<void(int id, EnclaveResult &&result)> on_result;
+  // 本轮中有任务等待生成 report 的 Enclave，在 work() 的最后对其调用
+  // e_quote_batch，通过 request_quote 加入
+  std::set<sgx_enclave_id_t> need_quote;
+  // 已完成的结果，仅在主线程中访问
+  ResultCache result_cache{RESULT_CACHE_SIZE};
+  // 创建的任务数和其中合并到已有任务上的数量，仅在主线程中修改
+  size_t requested_jobs = 0;
+  size_t coalesced_jobs = 0;
+  // 收到退出信号后置 true，test_run 停止创建任务并返回
+  std::atomic<bool> stopping = false;
+
+  // 根据 id 查找 Executor，不加锁，可以在多个 Enclave 线程中同时调用
+  // 调用者需要保证 Executor 在使用期间不被释放（e_work 期间由 Oracle::work
+  // 持有）
+  Executor *find_executor(int id) const {
+    if (id < 0) {
+      return nullptr;
+    }
+    auto p_executor = slots[id % MAX_WORKER].load(std::memory_order_acquire);
+    if (p_executor == nullptr || p_executor->id != id) {
+      return nullptr;
+    }
+    return p_executor;
+  }
+
+  // 任务所在的 Enclave，由 id 决定，在任务的生命周期内不变
+  static sgx_enclave_id_t enclave_of(int id) {
+    return global_eids[(unsigned)id % global_eids.size()];
+  }
 
   // 获取全局的对象
   static Oracle &global() {
@@ -46,8 +150,25 @@ class Oracle {
     return oracle;
   }
 
-  // 创建一个新的任务
-  void new_job(const std::string &address, const std::string &request);
+  // 请求停止，可以在信号处理函数中调用
+  void stop() { stopping.store(true); }
+
+  // 创建一个新的任务，返回其 id，结果通过 on_result 以该 id 交出
+  // 对应 Enclave 的内存达到 ENCLAVE_MEMORY_ADMIT 时不创建并返回 -1
+  // 给出 on_chunk 时使用流式模式，响应在读取过程中分段交出
+  // USE_HTTP2 时非流式任务作为 stream 挂载到 HTTP/2 连接上
+  // 与 COALESCE_WINDOW 内开始的非流式任务主机和请求相同时，合并到该任务，
+  // 不再单独访问和证明
+  // max_age 非零时，result_cache 中在此时间内获取的结果直接交出
+  int new_job(const std::string &address, const std::string &request,
+              StreamHandler on_chunk = nullptr,
+              steady_clock::duration max_age = steady_clock::duration::zero());
+
+  // Enclave 内存紧张，暂停该任务直到有内存释放
+  void throttle(boost::shared_ptr<Executor> p_executor);
+
+  // 该 Enclave 中有任务等待生成 report
+  void request_quote(sgx_enclave_id_t eid);
 
   // 遍历并执行所有任务
   void work();
@@ -55,7 +176,11 @@ class Oracle {
   // 某个异步 IO 操作完成，需要执行 Executor::work
   void need_work(boost::shared_ptr<Executor> p_executor);
 
-  void test_run(const std::string &address, const std::string &request);
+  // 不断创建任务，保持 concurrency 个任务同时进行，直到 stop()
+  // stress 为 true 时每个任务的请求路径不同，不会被合并，各 Enclave 的任务
+  // 并行执行，每轮检查 slots，结束时输出不一致的次数
+  void test_run(const std::string &address, const std::string &request,
+                int concurrency = 128, bool stress = false);
 };
 
 #endif  // _A_ORACLE_H_
\ No newline at end of file
@@ -0,0 +1,56 @@
+#include "ResultCache.h"
+
+// 一个结果占用的大小，包括 key 和 IAS 的回复
+size_t ResultCache::entry_size(const Entry &entry) {
+  return sizeof(Entry) + entry.key.size() + entry.result.size() +
+         entry.result.verification.size();
+}
+
+// 移除一个结果
+void ResultCache::erase(std::list<Entry>::iterator it) {
+  total_size -= entry_size(*it);
+  index.erase(it->key);
+  entries.erase(it);
+}
+
+// 查找 max_age 之内获取的结果，命中时复制一份写入 result 并返回 true
+bool ResultCache::find(const std::string &key, steady_clock::duration max_age,
+                       EnclaveResult &result) {
+  auto found = index.find(key);
+  if (found == index.end() ||
+      steady_clock::now() - found->second->fetch_time > max_age) {
+    // 过期的结果留在原处，之后被新结果替换或淘汰
+    misses += 1;
+    return false;
+  }
+  hits += 1;
+  entries.splice(entries.begin(), entries, found->second);
+  result = found->second->result.copy();
+  return true;
+}
+
+// 加入一个结果，已有同一 key 的更早结果时将其替换
+void ResultCache::insert(const std::string &key,
+                         time_point<steady_clock> fetch_time,
+                         const EnclaveResult &result) {
+  auto found = index.find(key);
+  if (found != index.end()) {
+    if (found->second->fetch_time >= fetch_time) {
+      return;
+    }
+    erase(found->second);
+  }
+  Entry entry{key, fetch_time, EnclaveResult()};
+  if (entry_size(entry) + result.size() + result.verification.size() >
+      capacity) {
+    // 单个结果超过上限时不缓存，也不淘汰其他结果
+    return;
+  }
+  entry.result = result.copy();
+  total_size += entry_size(entry);
+  entries.push_front(std::move(entry));
+  index.emplace(key, entries.begin());
+  while (total_size > capacity) {
+    erase(std::prev(entries.end()));
+  }
+}
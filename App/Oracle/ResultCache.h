@@ -0,0 +1,51 @@
+#ifndef _A_RESULTCACHE_H_
+#define _A_RESULTCACHE_H_
+
+#include <chrono>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include "EnclaveResult.h"
+
+using namespace std::chrono;
+
+// 已完成并经过 IAS 确认的结果，以主机和请求为 key，总大小超过上限时
+// 淘汰最久未使用的结果，仅在主线程中访问
+class ResultCache {
+ protected:
+  struct Entry {
+    std::string key;
+    // 产生该结果的任务开始的时间，响应不早于此时获取
+    time_point<steady_clock> fetch_time;
+    EnclaveResult result;
+  };
+  // 最近使用的在前
+  std::list<Entry> entries;
+  std::unordered_map<std::string, std::list<Entry>::iterator> index;
+  // 所有结果按 entry_size 计算的总大小和上限
+  size_t total_size = 0;
+  const size_t capacity;
+
+  // 一个结果占用的大小，包括 key 和 IAS 的回复
+  static size_t entry_size(const Entry &entry);
+
+  // 移除一个结果
+  void erase(std::list<Entry>::iterator it);
+
+ public:
+  // 查找命中和未命中的次数
+  size_t hits = 0;
+  size_t misses = 0;
+
+  explicit ResultCache(size_t capacity) : capacity(capacity) {}
+
+  // 查找 max_age 之内获取的结果，命中时复制一份写入 result 并返回 true
+  bool find(const std::string &key, steady_clock::duration max_age,
+            EnclaveResult &result);
+
+  // 加入一个结果，已有同一 key 的更早结果时将其替换
+  void insert(const std::string &key, time_point<steady_clock> fetch_time,
+              const EnclaveResult &result);
+};
+
+#endif  // _A_RESULTCACHE_H_
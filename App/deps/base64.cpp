@@ -32,95 +32,306 @@
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wconversion"
 #include "base64.h"
-#include <iostream>
+#include <stdint.h>
 
-static const std::string base64_chars = 
+// The SIMD paths follow W. Muła and D. Lemire, "Faster Base64 Encoding and
+// Decoding Using AVX2 Instructions" (ACM TWEB 2018). They are chosen at
+// runtime; the scalar code handles the tails and older CPUs.
+#if defined(__x86_64__)
+#define BASE64_HAVE_SIMD
+#include <immintrin.h>
+#endif
+
+static constexpr char base64_chars[] =
              "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
              "abcdefghijklmnopqrstuvwxyz"
              "0123456789+/";
 
+// Value of each character, 0xff for '=' and characters outside the alphabet.
+struct DecodeTable {
+  unsigned char values[256];
+  constexpr DecodeTable() : values() {
+    for (int i = 0; i < 256; i++) values[i] = 0xff;
+    for (int i = 0; i < 64; i++) values[(unsigned char)base64_chars[i]] = i;
+  }
+};
+static constexpr DecodeTable decode_table;
 
-static inline bool is_base64(unsigned char c) {
-  return (isalnum(c) || (c == '+') || (c == '/'));
+size_t base64_decoded_size(char const* in, size_t len) {
+  if (len >= 1 && in[len - 1] == '=') len--;
+  if (len >= 1 && in[len - 1] == '=') len--;
+  return len / 4 * 3 + (len % 4 > 1 ? len % 4 - 1 : 0);
 }
 
-std::string base64_encode(unsigned char const* bytes_to_encode, unsigned int in_len) {
-  std::string ret;
-  int i = 0;
-  int j = 0;
-  unsigned char char_array_3[3];
-  unsigned char char_array_4[4];
-
-  while (in_len--) {
-    char_array_3[i++] = *(bytes_to_encode++);
-    if (i == 3) {
-      char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-      char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-      char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-      char_array_4[3] = char_array_3[2] & 0x3f;
-
-      for(i = 0; (i <4) ; i++)
-        ret += base64_chars[char_array_4[i]];
-      i = 0;
-    }
+static size_t encode_scalar(unsigned char const* bytes, size_t len, char* out) {
+  char* p = out;
+  size_t i = 0;
+  for (; i + 3 <= len; i += 3) {
+    unsigned int n = (bytes[i] << 16) | (bytes[i + 1] << 8) | bytes[i + 2];
+    p[0] = base64_chars[(n >> 18) & 0x3f];
+    p[1] = base64_chars[(n >> 12) & 0x3f];
+    p[2] = base64_chars[(n >> 6) & 0x3f];
+    p[3] = base64_chars[n & 0x3f];
+    p += 4;
   }
+  if (i < len) {
+    unsigned int n = bytes[i] << 16;
+    if (i + 1 < len) n |= bytes[i + 1] << 8;
+    p[0] = base64_chars[(n >> 18) & 0x3f];
+    p[1] = base64_chars[(n >> 12) & 0x3f];
+    p[2] = i + 1 < len ? base64_chars[(n >> 6) & 0x3f] : '=';
+    p[3] = '=';
+    p += 4;
+  }
+  return p - out;
+}
 
-  if (i)
-  {
-    for(j = i; j < 3; j++)
-      char_array_3[j] = '\0';
-
-    char_array_4[0] = ( char_array_3[0] & 0xfc) >> 2;
-    char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-    char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
+// Stops at the first character that is not in the alphabet; a trailing
+// group of 2 or 3 characters yields 1 or 2 bytes.
+static size_t decode_scalar(char const* in, size_t len, unsigned char* out) {
+  unsigned char* p = out;
+  size_t i = 0;
+  unsigned int n = 0;
+  int count = 0;
+  for (; i < len; i++) {
+    unsigned char v = decode_table.values[(unsigned char)in[i]];
+    if (v == 0xff) break;
+    n = (n << 6) | v;
+    if (++count == 4) {
+      p[0] = n >> 16;
+      p[1] = n >> 8;
+      p[2] = n;
+      p += 3;
+      n = 0;
+      count = 0;
+    }
+  }
+  if (count >= 2) {
+    n <<= 6 * (4 - count);
+    *p++ = n >> 16;
+    if (count == 3) *p++ = n >> 8;
+  }
+  return p - out;
+}
 
-    for (j = 0; (j < i + 1); j++)
-      ret += base64_chars[char_array_4[j]];
+#ifdef BASE64_HAVE_SIMD
+// Encoding, per 128-bit lane: spread 12 input bytes to 16 six-bit indices,
+// then map indices to ASCII with one pshufb over the range offsets.
+__attribute__((target("ssse3")))
+static inline __m128i encode_indices_ssse3(__m128i in) {
+  in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7,
+                                         4, 5, 3, 4, 1, 2, 0, 1));
+  const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+  const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+  const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+  const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+  return _mm_or_si128(t1, t3);
+}
 
-    while((i++ < 3))
-      ret += '=';
+__attribute__((target("ssse3")))
+static inline __m128i encode_ascii_ssse3(__m128i indices) {
+  const __m128i offsets = _mm_setr_epi8(
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+      '/' - 63, 'A', 0, 0);
+  __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+  const __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+  range = _mm_or_si128(range, _mm_and_si128(upper, _mm_set1_epi8(13)));
+  return _mm_add_epi8(_mm_shuffle_epi8(offsets, range), indices);
+}
 
+// Each step reads 16 bytes and consumes 12.
+__attribute__((target("ssse3")))
+static size_t encode_ssse3(unsigned char const* bytes, size_t len, char* out) {
+  size_t i = 0;
+  char* p = out;
+  for (; i + 16 <= len; i += 12, p += 16) {
+    __m128i in = _mm_loadu_si128((const __m128i*)(bytes + i));
+    _mm_storeu_si128((__m128i*)p,
+                     encode_ascii_ssse3(encode_indices_ssse3(in)));
   }
+  return (p - out) + encode_scalar(bytes + i, len - i, p);
+}
 
-  return ret;
-
+__attribute__((target("avx2")))
+static size_t encode_avx2(unsigned char const* bytes, size_t len, char* out) {
+  const __m256i shuffle = _mm256_setr_epi8(
+      1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+      1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+  const __m256i offsets = _mm256_setr_epi8(
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+      '/' - 63, 'A', 0, 0,
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+      '/' - 63, 'A', 0, 0);
+  size_t i = 0;
+  char* p = out;
+  // Each step reads 12 + 16 bytes and consumes 24.
+  for (; i + 28 <= len; i += 24, p += 32) {
+    __m256i in = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(bytes + i))),
+        _mm_loadu_si128((const __m128i*)(bytes + i + 12)), 1);
+    in = _mm256_shuffle_epi8(in, shuffle);
+    const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+    const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+    const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    const __m256i indices = _mm256_or_si256(t1, t3);
+    __m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+    const __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+    range = _mm256_or_si256(range,
+                            _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+    _mm256_storeu_si256(
+        (__m256i*)p,
+        _mm256_add_epi8(_mm256_shuffle_epi8(offsets, range), indices));
+  }
+  return (p - out) + encode_scalar(bytes + i, len - i, p);
 }
 
-std::string base64_decode(std::string const& encoded_string) {
-  size_t in_len = encoded_string.size();
-  int i = 0;
-  int j = 0;
-  int in_ = 0;
-  unsigned char char_array_4[4], char_array_3[3];
-  std::string ret;
-
-  while (in_len-- && ( encoded_string[in_] != '=') && is_base64(encoded_string[in_])) {
-    char_array_4[i++] = encoded_string[in_]; in_++;
-    if (i ==4) {
-      for (i = 0; i <4; i++)
-        char_array_4[i] = base64_chars.find(char_array_4[i]) & 0xff;
-
-      char_array_3[0] = ( char_array_4[0] << 2       ) + ((char_array_4[1] & 0x30) >> 4);
-      char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-      char_array_3[2] = ((char_array_4[2] & 0x3) << 6) +   char_array_4[3];
-
-      for (i = 0; (i < 3); i++)
-        ret += char_array_3[i];
-      i = 0;
+// Decoding, per 128-bit lane: classify every character by its nibbles
+// (any bit set in lut_lo & lut_hi marks a character outside the alphabet,
+// '=' included), add the per-range offset to get 6-bit values, then pack
+// 16 values into 12 bytes. A block containing an invalid character is left
+// to the scalar code, which stops at it.
+__attribute__((target("ssse3")))
+static size_t decode_ssse3(char const* in, size_t len, unsigned char* out) {
+  const __m128i lut_lo = _mm_setr_epi8(
+      0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+      0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+  const __m128i lut_hi = _mm_setr_epi8(
+      0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m128i lut_roll = _mm_setr_epi8(
+      0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i nibble = _mm_set1_epi8(0x0f);
+  size_t i = 0;
+  unsigned char* p = out;
+  // The 16-byte store writes 4 bytes past the 12 decoded ones; keeping 8
+  // more characters after the block guarantees they are still inside out.
+  for (; i + 24 <= len; i += 16, p += 12) {
+    const __m128i input = _mm_loadu_si128((const __m128i*)(in + i));
+    const __m128i hi = _mm_and_si128(_mm_srli_epi32(input, 4), nibble);
+    const __m128i lo = _mm_and_si128(input, nibble);
+    const __m128i invalid = _mm_and_si128(_mm_shuffle_epi8(lut_lo, lo),
+                                          _mm_shuffle_epi8(lut_hi, hi));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(invalid, _mm_setzero_si128())) !=
+        0xffff) {
+      break;
     }
+    const __m128i slash = _mm_cmpeq_epi8(input, _mm_set1_epi8('/'));
+    const __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(slash, hi));
+    const __m128i values = _mm_add_epi8(input, roll);
+    const __m128i pairs =
+        _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    const __m128i words = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+    _mm_storeu_si128(
+        (__m128i*)p,
+        _mm_shuffle_epi8(words, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14,
+                                              13, 12, -1, -1, -1, -1)));
   }
+  return (p - out) + decode_scalar(in + i, len - i, p);
+}
 
-  if (i) {
-    for (j = 0; j < i; j++)
-      char_array_4[j] = base64_chars.find(char_array_4[j]) & 0xff;
+__attribute__((target("avx2")))
+static size_t decode_avx2(char const* in, size_t len, unsigned char* out) {
+  const __m256i lut_lo = _mm256_setr_epi8(
+      0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+      0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+      0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+      0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+  const __m256i lut_hi = _mm256_setr_epi8(
+      0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+      0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m256i lut_roll = _mm256_setr_epi8(
+      0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i pack = _mm256_setr_epi8(
+      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  const __m256i nibble = _mm256_set1_epi8(0x0f);
+  size_t i = 0;
+  unsigned char* p = out;
+  // The 32-byte store writes 8 bytes past the 24 decoded ones; 16 more
+  // characters after the block keep them inside out.
+  for (; i + 48 <= len; i += 32, p += 24) {
+    const __m256i input = _mm256_loadu_si256((const __m256i*)(in + i));
+    const __m256i hi = _mm256_and_si256(_mm256_srli_epi32(input, 4), nibble);
+    const __m256i lo = _mm256_and_si256(input, nibble);
+    const __m256i invalid =
+        _mm256_and_si256(_mm256_shuffle_epi8(lut_lo, lo),
+                         _mm256_shuffle_epi8(lut_hi, hi));
+    if (!_mm256_testz_si256(invalid, invalid)) break;
+    const __m256i slash = _mm256_cmpeq_epi8(input, _mm256_set1_epi8('/'));
+    const __m256i roll =
+        _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(slash, hi));
+    const __m256i values = _mm256_add_epi8(input, roll);
+    const __m256i pairs =
+        _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+    const __m256i words =
+        _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+    // 12 bytes at the start of each lane, then join the two lanes
+    const __m256i packed = _mm256_permutevar8x32_epi32(
+        _mm256_shuffle_epi8(words, pack),
+        _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+    _mm256_storeu_si256((__m256i*)p, packed);
+  }
+  return (p - out) + decode_scalar(in + i, len - i, p);
+}
 
-    char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-    char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
+enum SimdLevel { Scalar, Ssse3, Avx2 };
 
-    for (j = 0; (j < i - 1); j++) ret += char_array_3[j];
+// __builtin_cpu_supports also checks that the OS saves the AVX state.
+static SimdLevel simd_level() {
+  static const SimdLevel level = __builtin_cpu_supports("avx2")    ? Avx2
+                                 : __builtin_cpu_supports("ssse3") ? Ssse3
+                                                                   : Scalar;
+  return level;
+}
+#endif
+
+size_t base64_encode(unsigned char const* bytes, size_t len, char* out) {
+#ifdef BASE64_HAVE_SIMD
+  switch (simd_level()) {
+    case Avx2:
+      return encode_avx2(bytes, len, out);
+    case Ssse3:
+      return encode_ssse3(bytes, len, out);
+    default:
+      break;
   }
+#endif
+  return encode_scalar(bytes, len, out);
+}
 
+size_t base64_decode(char const* in, size_t len, unsigned char* out) {
+#ifdef BASE64_HAVE_SIMD
+  switch (simd_level()) {
+    case Avx2:
+      return decode_avx2(in, len, out);
+    case Ssse3:
+      return decode_ssse3(in, len, out);
+    default:
+      break;
+  }
+#endif
+  return decode_scalar(in, len, out);
+}
+
+std::string base64_encode(unsigned char const* bytes_to_encode, unsigned int in_len) {
+  std::string ret(base64_encoded_size(in_len), '\0');
+  base64_encode(bytes_to_encode, in_len, &ret[0]);
+  return ret;
+}
+
+std::string base64_decode(std::string const& encoded_string) {
+  std::string ret(
+      base64_decoded_size(encoded_string.data(), encoded_string.size()), '\0');
+  ret.resize(base64_decode(encoded_string.data(), encoded_string.size(),
+                           (unsigned char*)&ret[0]));
   return ret;
 }
 
-#pragma GCC diagnostic pop
\ No newline at end of file
+#pragma GCC diagnostic pop
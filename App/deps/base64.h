@@ -2,12 +2,32 @@
 //  base64 encoding and decoding with C++.
 //  Version: 1.01.00
 //
+//  Altered for this project: buffer-based entry points with exact output
+//  sizing, and SSSE3/AVX2 code paths selected at runtime.
+//
 
 #ifndef BASE64_H_C0CE2A47_D10E_42C9_A27C_C883944E704A
 #define BASE64_H_C0CE2A47_D10E_42C9_A27C_C883944E704A
 
+#include <stddef.h>
 #include <string>
 
+// Number of characters produced by encoding len bytes, including padding.
+inline size_t base64_encoded_size(size_t len) { return (len + 2) / 3 * 4; }
+
+// Number of bytes produced by decoding the len characters at in. Exact for
+// well-formed input (trailing '=' are discounted); an upper bound otherwise.
+size_t base64_decoded_size(char const* in, size_t len);
+
+// Encodes directly into out, which must hold base64_encoded_size(len)
+// characters. Returns the number of characters written.
+size_t base64_encode(unsigned char const* bytes, size_t len, char* out);
+
+// Decodes into out, which must hold base64_decoded_size(in, len) bytes.
+// Like the string version, decoding stops at the first '=' or character
+// outside the alphabet. Returns the number of bytes written.
+size_t base64_decode(char const* in, size_t len, unsigned char* out);
+
 std::string base64_encode(unsigned char const* , unsigned int len);
 std::string base64_decode(std::string const& s);
 
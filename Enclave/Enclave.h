@@ -45,6 +45,7 @@ extern "C" {
 #endif
 
 void printf(const char *fmt, ...);
+double current_time(void);
 
 #if defined(__cplusplus)
 }
@@ -1,35 +1,17 @@
 // 向目标地址请求网页
 #include "Client.h"
-#include <wolfssl/wolfcrypt/sha512.h>
-#include <wolfssl/wolfio.h>
+#include <ctype.h>
+#include <limits.h>
+#include <algorithm>
 #include <map>
 #include "Enclave/Enclave_t.h"
 #include "Enclave/deps/cJSON.h"
+#include "Http2Connection.h"
+#include "Snapshot.h"
 #include "WolfSSL.h"
 #include "sgx_trts.h"
 #include "sgx_uae_service.h"
 
-// 给定 WolfSSL 对于某一操作的返回值，
-// 返回 StatusCode::Success, StatusCode::LibraryError 或 StatusCode::Blocking
-StatusCode Client::parse_wolfssl_status(int ret) const {
-  if (ret == SSL_SUCCESS) {
-    return StatusCode::Success;
-  } else {
-    // WolfSSL 应当返回等待 IO 的错误代码
-    auto err = wolfSSL_get_error(ssl, ret);
-    switch (err) {
-      case SSL_ERROR_WANT_READ:
-      case SSL_ERROR_WANT_WRITE:
-        return StatusCode::Blocking;
-      default:
-        ERROR("Client %d failed with message: %s", id,
-              get_wolfssl_error_str(err));
-        return StatusCode::LibraryError;
-    }
-  }
-  UNREACHABLE();
-}
-
 // 发起握手连接，非阻塞，需要重复调用直到返回 StatusCode::Success
 StatusCode Client::connect() const {
   return parse_wolfssl_status(wolfSSL_connect(ssl));
@@ -55,53 +37,354 @@ StatusCode Client::write() {
 
 // 接收内容，非阻塞，需要重复调用直到收到足够数据
 // 重复从 socket 中进行读取，直到 socket 被阻塞
+// 明文直接交给 http_parser，由回调将响应头和去掉 chunked 编码的响应体分别存入
+// headers 和 body，不再保留原始响应
 StatusCode Client::read() {
-  static char buffer[SOCKET_READ_SIZE];
-  auto old_size = response.size();
+  // 每次调用使用栈上的缓冲区，多个 Enclave 线程可以同时读取
+  char buffer[SOCKET_READ_SIZE];
   auto ret = wolfSSL_read(ssl, buffer, SOCKET_READ_SIZE);
   // 重复读直到 socket 没有准备好的数据
   while (ret > 0) {
-    response.append(buffer, ret);
-    // 拒绝过大的网页响应
-    if (response.size() > MAX_RESPONSE_SIZE) {
-      return StatusCode::ResponseTooLarge;
+    auto parse_size =
+        http_parser_execute(&parser, &parser_settings, buffer, (size_t)ret);
+    // 检查回调和解析错误
+    if (parse_status.is_error()) {
+      return parse_status;
+    }
+    if (parse_size < (size_t)ret) {
+      return StatusCode::ParserError;
+    }
+    if (response_complete) {
+      break;
     }
     ret = wolfSSL_read(ssl, buffer, SOCKET_READ_SIZE);
   }
-  // 本次 read() 没有读取到任何数据，则直接返回
-  if (response.size() == old_size) {
+  // 检查是否解析完成，压缩数据也必须完整（204、304、HEAD 等没有响应体）
+  if (response_complete) {
+    if (inflater != nullptr && inflater->get_total_input() > 0 &&
+        !inflater->finished()) {
+      return StatusCode::DecodeError;
+    }
+    return StatusCode::Success;
+  } else {
     return parse_wolfssl_status(ret);
   }
-  // 解析网页
-  auto parse_size =
-      http_parser_execute(&parser, &parser_settings, response.data() + old_size,
-                          response.size() - old_size);
-  // 检查解析错误
-  if (parse_size < response.size() - old_size) {
-    return StatusCode::ParserError;
+}
+
+// 流式模式下的 read()，响应完整时计算出 stream_digest
+// 每段明文先交给 http_parser 并计入 hash，累积到 STREAM_CHUNK_SIZE 或本次读取
+// 结束时交给 App，Enclave 内的占用与响应大小无关
+StatusCode Client::read_stream() {
+  char buffer[SOCKET_READ_SIZE];
+  auto ret = wolfSSL_read(ssl, buffer, SOCKET_READ_SIZE);
+  while (ret > 0) {
+    auto parse_size =
+        http_parser_execute(&parser, &parser_settings, buffer, (size_t)ret);
+    if (parse_size < (size_t)ret) {
+      return StatusCode::ParserError;
+    }
+    wc_Sha512Update(&stream_sha, (const unsigned char *)buffer, (unsigned)ret);
+    stream_buffer.append(buffer, (size_t)ret);
+    if (stream_buffer.size() >= STREAM_CHUNK_SIZE) {
+      flush_stream();
+    }
+    if (response_complete) {
+      break;
+    }
+    ret = wolfSSL_read(ssl, buffer, SOCKET_READ_SIZE);
   }
-  // 检查是否解析完成
+  flush_stream();
   if (response_complete) {
+    wc_Sha512Final(&stream_sha, stream_digest);
     return StatusCode::Success;
   } else {
     return parse_wolfssl_status(ret);
   }
 }
 
-// 根据错误代码，打印 WolfSSL 的错误信息
-const char *Client::get_wolfssl_error_str(int err) const {
-  static char buffer[89] = "WOLFSSL: ";
-  wolfSSL_ERR_error_string((unsigned long)err, buffer + 9);
-  return buffer;
+// 将 stream_buffer 通过 o_stream 交给 App
+void Client::flush_stream() {
+  if (stream_buffer.empty()) {
+    return;
+  }
+  o_stream(id, stream_buffer.data(), stream_buffer.size());
+  streamed_size += stream_buffer.size();
+  stream_buffer.clear();
 }
 
+// 所有 Client 共用的回调，未设置的回调为空指针
+const http_parser_settings Client::parser_settings = [] {
+  http_parser_settings settings = {};
+  settings.on_message_complete = on_message_complete;
+  settings.on_status = on_status;
+  settings.on_header_field = on_header_field;
+  settings.on_header_value = on_header_value;
+  settings.on_headers_complete = on_headers_complete;
+  settings.on_body = on_body;
+  settings.on_chunk_header = on_chunk_header;
+  return settings;
+}();
+
 // 初始化 http_parser，在消息结束时置 response_complete = true
 void Client::init_parser() {
-  parser_settings.on_message_complete = [&](auto) {
-    response_complete = true;
+  http_parser_init(&parser, HTTP_RESPONSE);
+  parser.data = this;
+}
+
+// http_parser 的回调，通过 parser->data 找到对应的 Client
+int Client::on_message_complete(http_parser *parser) {
+  auto &client = *(Client *)parser->data;
+  client.response_complete = true;
+  return 0;
+}
+
+int Client::on_status(http_parser *parser, const char *at, size_t length) {
+  auto &client = *(Client *)parser->data;
+  if (!client.streaming) {
+    client.begin_headers();
+    client.headers.append(at, length);
+  }
+  return 0;
+}
+
+int Client::on_header_field(http_parser *parser, const char *at,
+                            size_t length) {
+  auto &client = *(Client *)parser->data;
+  if (client.reading_header_value) {
+    client.end_header();
+  }
+  client.header_field.append(at, length);
+  return 0;
+}
+
+int Client::on_header_value(http_parser *parser, const char *at,
+                            size_t length) {
+  auto &client = *(Client *)parser->data;
+  client.reading_header_value = true;
+  client.header_value.append(at, length);
+  return 0;
+}
+
+// 返回非 0 值使 http_parser 报错（返回 1 表示跳过响应体，不能使用）
+int Client::on_headers_complete(http_parser *parser) {
+  auto &client = *(Client *)parser->data;
+  if (client.reading_header_value) {
+    client.end_header();
+  }
+  client.headers_complete = true;
+  if (client.streaming) {
     return 0;
+  }
+  return client.finish_headers(parser->content_length) ? 0 : -1;
+}
+
+// 响应体已去掉 chunked 编码，直接追加到 body，压缩时先交给 inflater
+int Client::on_body(http_parser *parser, const char *at, size_t length) {
+  auto &client = *(Client *)parser->data;
+  if (client.streaming) {
+    return 0;
+  }
+  return client.receive_body(at, length) ? 0 : -1;
+}
+
+// 响应头结束，content_length 未知时为 ULLONG_MAX，出错时返回 false
+bool Client::finish_headers(uint64_t content_length) {
+  headers_complete = true;
+  begin_headers();
+  headers.append("\r\n\r\n");
+  headers.shrink_to_fit();
+  // 有 Content-Length 时一次分配完整的响应体，解压时无法预知长度
+  auto decoded = inflater != nullptr && ATTEST_DECODED_BODY;
+  if (content_length != ULLONG_MAX && !decoded &&
+      !reserve_body(content_length)) {
+    parse_status = StatusCode::ResponseTooLarge;
+  }
+  return !parse_status.is_error();
+}
+
+// 追加一段响应体，出错时设置 parse_status 并返回 false
+bool Client::receive_body(const char *at, size_t length) {
+  if (inflater != nullptr) {
+    // 证明压缩数据时仍然完整解压，以检查数据有效和解压后的长度
+    parse_status =
+        inflater->feed(at, length, ATTEST_DECODED_BODY ? &body : nullptr);
+    if (parse_status.is_error()) {
+      return false;
+    }
+    if (ATTEST_DECODED_BODY) {
+      return true;
+    }
+  }
+  if (body.size() + length > MAX_RESPONSE_SIZE) {
+    parse_status = StatusCode::ResponseTooLarge;
+    return false;
+  }
+  body.append(at, length);
+  return true;
+}
+
+// 每个 chunk 开始时，parser->content_length 为该 chunk 的长度
+int Client::on_chunk_header(http_parser *parser) {
+  auto &client = *(Client *)parser->data;
+  if (client.streaming || (client.inflater != nullptr && ATTEST_DECODED_BODY)) {
+    return 0;
+  }
+  if (!client.reserve_body(client.body.size() + parser->content_length)) {
+    client.parse_status = StatusCode::ResponseTooLarge;
+    return -1;
+  }
+  return 0;
+}
+
+// 在 headers 中写入状态行的版本和状态码，原因短语由 on_status 追加
+void Client::begin_headers() {
+  if (headers.empty()) {
+    headers = format("HTTP/%d.%d %d ", parser.http_major, parser.http_minor,
+                     parser.status_code);
+  }
+}
+
+// HTTP/2 的响应头，按与 HTTP/1.1 相同的格式存入 headers，出错时返回 false
+bool Client::receive_http2_headers(const std::vector<HeaderField> &fields) {
+  uint64_t content_length = ULLONG_MAX;
+  for (auto &field : fields) {
+    if (field.first == ":status") {
+      headers = "HTTP/2 " + field.second;
+      continue;
+    } else if (field.first == "content-length") {
+      content_length = strtoull(field.second.c_str(), nullptr, 10);
+    }
+    header_field = field.first;
+    header_value = field.second;
+    end_header();
+  }
+  if (headers.empty()) {
+    ERROR("Client %d: HTTP/2 response without :status", id);
+    parse_status = StatusCode::ParserError;
+    return false;
+  }
+  return finish_headers(content_length);
+}
+
+// 由 Http2Connection 在 stream 结束时调用，之后 work() 返回结果或错误
+void Client::finish_http2(StatusCode status) {
+  if (status.is_error()) {
+    parse_status = status;
+  } else {
+    response_complete = true;
+  }
+}
+
+// HTTP/2 模式下的 work()，IO 由 Http2Connection 完成，这里只检查进度
+StatusCode Client::work_http2() {
+  if (parse_status.is_error()) {
+    return parse_status;
+  }
+  switch (state) {
+    case Connecting:
+    case Reading: {
+      if (!response_complete) {
+        return StatusCode::Blocking;
+      }
+      if (inflater != nullptr && inflater->get_total_input() > 0 &&
+          !inflater->finished()) {
+        return StatusCode::DecodeError;
+      }
+      LOG("Response received over HTTP/2");
+      response = wrap();
+      std::string().swap(headers);
+      std::string().swap(body);
+      state = Quoting;
+      return StatusCode::Quoting;
+    }
+    case Quoting: {
+      return StatusCode::Quoting;
+    }
+    case Complete: {
+      return StatusCode::Success;
+    }
+    default: { UNREACHABLE(); }
+  }
+}
+
+// 为响应体预留 size 字节，超过 MAX_RESPONSE_SIZE 时返回 false
+// chunk 较小时按倍数增长，避免每个 chunk 都重新分配
+bool Client::reserve_body(uint64_t size) {
+  if (size > MAX_RESPONSE_SIZE) {
+    return false;
+  }
+  if (size > body.capacity()) {
+    body.reserve(std::min(std::max((size_t)size, body.capacity() * 2),
+                          (size_t)MAX_RESPONSE_SIZE));
+  }
+  return true;
+}
+
+// 处理一个完整的响应头，存入 headers，并根据 Content-Encoding 创建 inflater
+void Client::end_header() {
+  if (streaming || headers_complete) {
+    // 流式模式不保留响应头，trailer 不计入
+    header_field.clear();
+    header_value.clear();
+    reading_header_value = false;
+    return;
+  }
+  begin_headers();
+  headers.append("\r\n");
+  headers.append(header_field);
+  headers.append(": ");
+  headers.append(header_value);
+  auto lower = [](std::string &str) {
+    for (auto &c : str) {
+      c = (char)tolower((unsigned char)c);
+    }
   };
-  http_parser_init(&parser, HTTP_RESPONSE);
+  lower(header_field);
+  if (header_field == "content-encoding") {
+    lower(header_value);
+    if (header_value == "gzip" || header_value == "x-gzip") {
+      inflater.reset(new Inflater(Inflater::Gzip, MAX_RESPONSE_SIZE));
+    } else if (header_value == "deflate") {
+      inflater.reset(new Inflater(Inflater::Deflate, MAX_RESPONSE_SIZE));
+    } else if (header_value != "identity") {
+      // 包括多重编码，请求中只声明了 gzip 和 deflate
+      ERROR("Client %d: unsupported Content-Encoding '%s'", id,
+            header_value.c_str());
+      parse_status = StatusCode::DecodeError;
+    }
+  }
+  header_field.clear();
+  header_value.clear();
+  reading_header_value = false;
+}
+
+// 将数据编码为 base64，用于在 json 中放入二进制的响应体
+static std::string base64_encode(const std::string &data) {
+  static const char table[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string encoded;
+  encoded.reserve((data.size() + 2) / 3 * 4);
+  size_t i = 0;
+  for (; i + 2 < data.size(); i += 3) {
+    auto n = (uint32_t)(unsigned char)data[i] << 16 |
+             (uint32_t)(unsigned char)data[i + 1] << 8 |
+             (uint32_t)(unsigned char)data[i + 2];
+    encoded.push_back(table[n >> 18]);
+    encoded.push_back(table[(n >> 12) & 63]);
+    encoded.push_back(table[(n >> 6) & 63]);
+    encoded.push_back(table[n & 63]);
+  }
+  if (i < data.size()) {
+    auto n = (uint32_t)(unsigned char)data[i] << 16;
+    if (i + 1 < data.size()) {
+      n |= (uint32_t)(unsigned char)data[i + 1] << 8;
+    }
+    encoded.push_back(table[n >> 18]);
+    encoded.push_back(table[(n >> 12) & 63]);
+    encoded.push_back(i + 1 < data.size() ? table[(n >> 6) & 63] : '=');
+    encoded.push_back('=');
+  }
+  return encoded;
 }
 
 // 打包一个用于生成 quote 的数据，包含所有必要信息
@@ -109,7 +392,13 @@ std::string Client::wrap() const {
   auto obj = cJSON_CreateObject();
   // todo: time
   cJSON_AddStringToObject(obj, "request", request.c_str());
-  cJSON_AddStringToObject(obj, "response", response.c_str());
+  // 压缩的响应在不证明解压后的数据时，放入 base64 编码的原始响应体
+  if (inflater != nullptr && !ATTEST_DECODED_BODY) {
+    cJSON_AddStringToObject(obj, "response", headers.c_str());
+    cJSON_AddStringToObject(obj, "body_base64", base64_encode(body).c_str());
+  } else {
+    cJSON_AddStringToObject(obj, "response", (headers + body).c_str());
+  }
   auto json_dump = cJSON_Print(obj);
   std::string str = json_dump;
   cJSON_free(json_dump);
@@ -117,18 +406,48 @@ std::string Client::wrap() const {
   return str;
 }
 
-Client::Client(const std::string &hostname, std::string &&request, int id)
-    : id(id), ssl(wolfSSL_new(global_ctx)), request(std::move(request)) {
-  wolfSSL_set_fd(ssl, id);
+Client::Client(const std::string &hostname, std::string &&request, int id,
+               bool streaming, Http2Connection *connection)
+    : TlsSocket(id, connection == nullptr),
+      hostname(hostname),
+      request(std::move(request)),
+      streaming(streaming),
+      http2(connection != nullptr),
+      connection(connection) {
+  init_parser();
+  if (http2) {
+    connection->attach(this);
+    account();
+    return;
+  }
   LOG("check hostname: '%s'", hostname.c_str());
   wolfSSL_check_domain_name(ssl, hostname.c_str());
-  init_parser();
+  // 以 hostname 在 WolfSSL 的客户端缓存中查找之前的 session 进行复用，
+  // 该缓存会随快照保存
+  wolfSSL_SetServerID(ssl, (const unsigned char *)hostname.data(),
+                      (int)hostname.size(), 0);
+  if (streaming) {
+    // 先将请求计入 hash，之后依次加入响应的明文
+    uint64_t request_size = this->request.size();
+    unsigned char size_le[8];
+    for (int i = 0; i < 8; i++) {
+      size_le[i] = (unsigned char)(request_size >> (8 * i));
+    }
+    wc_InitSha512(&stream_sha);
+    wc_Sha512Update(&stream_sha, size_le, sizeof(size_le));
+    wc_Sha512Update(&stream_sha, (const unsigned char *)this->request.data(),
+                    (unsigned)this->request.size());
+  }
+  account();
 }
 
 // 对应 socket 准备好时调用，继续进行一步操作，当 IO 再次等待时返回
 // 仅当全部流程处理完时返回 StatusCode::Success，否则返回 StatusCode::Blocking
 // 或错误代码
 StatusCode Client::work() {
+  if (http2) {
+    return work_http2();
+  }
   while (true) {
     switch (state) {
       case Connecting: {
@@ -136,7 +455,14 @@ StatusCode Client::work() {
         switch (connect()) {
           case StatusCode::Success: {
             // 成功后则转 Writing 继续执行
-            LOG("Connected");
+            auto &stats = host_stats[hostname];
+            stats.connections += 1;
+            if (wolfSSL_session_reused(ssl)) {
+              stats.resumed += 1;
+            }
+            LOG("Connected after %d o_recv and %d o_send, session %s",
+                recv_buffer.get_ocall_count(), send_ocall_count,
+                wolfSSL_session_reused(ssl) ? "resumed" : "new");
             state = Writing;
             continue;
           }
@@ -173,11 +499,25 @@ StatusCode Client::work() {
         }
       }
       case Reading: {
+        // Enclave 内存紧张时暂停读取较大的响应，由 App 在内存释放后重试
+        if (memory_accountant.should_pause(id, accounted_bytes)) {
+          return StatusCode::Throttled;
+        }
         // 正在读取并处理响应，仅当读取完时返回 Success
-        switch (read()) {
+        auto status = streaming ? read_stream() : read();
+        switch (status) {
           case StatusCode::Success: {
-            // 响应接收完成
-            LOG("Response received");
+            // 响应接收完成，获取需要 hash 的全部信息
+            // 流式模式下 hash 已经计算完成
+            if (streaming) {
+              LOG("Response streamed: %lu bytes", (unsigned long)streamed_size);
+            } else {
+              LOG("Response received");
+              response = wrap();
+              // 已经打包进 response，释放响应头和响应体
+              std::string().swap(headers);
+              std::string().swap(body);
+            }
             state = Quoting;
             continue;
           }
@@ -189,41 +529,53 @@ StatusCode Client::work() {
             return StatusCode::LibraryError;
           }
           case StatusCode::ParserError: {
-            LOG("Parsing failed for message:\n%s", response.c_str());
+            LOG("Parsing failed for message:\n%s", headers.c_str());
             return StatusCode::ParserError;
           }
+          case StatusCode::ResponseTooLarge:
+          case StatusCode::DecodeError: {
+            LOG("Reading failed: %s", status.message());
+            return status;
+          }
           default: { UNREACHABLE(); }
         }
       }
       case Quoting: {
-        // 获取需要 hash 的全部信息
-        LOG("Getting JSON dump");
-        response = wrap();
-        // hash
-        LOG("Hashing");
-        Sha512 sha512;
-        unsigned char sha_sum[64];
-        static_assert(sizeof(sgx_report_data_t) == 64);
-        wc_InitSha512(&sha512);
-        wc_Sha512Update(&sha512, (const unsigned char *)response.data(),
-                        (unsigned)response.size());
-        wc_Sha512Final(&sha512, sha_sum);
-        // 生成 report
-        LOG("Creating Report");
-        sgx_create_report(&target_info, (sgx_report_data_t *)sha_sum, &report);
-        state = Complete;
-        return StatusCode::Success;
+        // 等待 e_quote_batch 与其他 Client 一起计算 hash 并生成 report
+        return StatusCode::Quoting;
       }
       case Complete: {
-        UNREACHABLE();
+        return StatusCode::Success;
       }
       default: { UNIMPLEMENTED(); }
     }
   }
 }
 
-// 释放 ssl 对象
+// 将当前在 Enclave 堆中的占用更新到 memory_accountant，每次 work() 后调用
+void Client::account() {
+  // HTTP/2 的 stream 没有自己的 WolfSSL 对象和缓冲区
+  auto bytes = sizeof(Client) + (http2 ? 0 : SSL_MEMORY_ESTIMATE) +
+               recv_buffer.capacity() + send_buffer.capacity() +
+               stream_buffer.capacity() + response.capacity() +
+               headers.capacity() + body.capacity() +
+               (inflater != nullptr ? sizeof(Inflater) : 0);
+  memory_accountant.update(id, accounted_bytes, bytes);
+  accounted_bytes = bytes;
+}
+
+// 由 e_quote_batch 计算打包数据的 hash 后调用，生成 report
+void Client::create_report(const unsigned char *sha_sum) {
+  static_assert(sizeof(sgx_report_data_t) == 64);
+  LOG("Creating Report");
+  sgx_create_report(&target_info, (const sgx_report_data_t *)sha_sum, &report);
+  state = Complete;
+}
+
+// 从 Http2Connection 和 memory_accountant 中移除
 Client::~Client() {
-  LOG("Free SSL object")
-  wolfSSL_free(ssl);
+  if (connection != nullptr) {
+    connection->detach(this);
+  }
+  memory_accountant.remove(id, accounted_bytes);
 }
\ No newline at end of file
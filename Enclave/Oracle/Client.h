@@ -5,11 +5,20 @@
 #include "Shared/Config.h"
 #include "Shared/Logging.h"
 #include "Shared/StatusCode.h"
+#include "Hpack.h"
+#include "Inflater.h"
+#include "MemoryAccountant.h"
+#include "Sha512Batch.h"
 #include "Shared/deps/http_parser.h"
+#include "TlsSocket.h"
 #include "WolfSSL.h"
 #include "sgx_utils.h"
+#include <wolfssl/wolfcrypt/sha512.h>
+#include <memory>
 
-class Client {
+class Http2Connection;
+
+class Client : public TlsSocket {
  public:
   enum State {
     Connecting,
@@ -20,28 +29,57 @@ class Client {
   };
 
  protected:
-  // 与 App 中共享的 id
-  const int id;
+  // 目标主机，用于 session 复用和统计
+  const std::string hostname;
   // 当前状态
   State state = Connecting;
-  // Session
-  WOLFSSL *const ssl;
   // 需要发送的消息
   const std::string request;
   // 已经写完的长度
   int written_size = 0;
-  // 解析回复
+  // 解析回复，parser.data 指向当前 Client
   http_parser parser;
-  http_parser_settings parser_settings;
-  // 回复，在生成 report 时会替换成一个表示全部信息的 json
+  // 所有 Client 共用的回调
+  static const http_parser_settings parser_settings;
+  // 响应接收完成后，由 wrap() 生成的表示全部信息的 json
   std::string response;
+  // 状态行和响应头，按 "\r\nName: value" 依次存放，不含 chunked 编码的
+  // trailer；原始的响应字节不再保留
+  std::string headers;
+  // 去掉 chunked 编码后连续存放的响应体，按 Content-Length 或 chunk 长度预先
+  // 分配；压缩时按 ATTEST_DECODED_BODY 为解压后或原始的数据
+  std::string body;
+  // 响应头是否已经结束，之后的响应头回调为 trailer
+  bool headers_complete = false;
   sgx_report_t report;
   // 当 http_parser 调用完成回调时，设置为 true，停止读取
   bool response_complete = false;
-
-  // 给定 WolfSSL 对于某一操作的返回值，
-  // 返回 StatusCode::Success, StatusCode::LibraryError 或 StatusCode::Blocking
-  StatusCode parse_wolfssl_status(int ret) const;
+  // 上次 account() 时记入 memory_accountant 的字节数
+  size_t accounted_bytes = 0;
+  // 流式模式：响应不保留在 Enclave 中，读到的明文边解析边通过 o_stream 交给
+  // App，同时计算 SHA-512，report 对 8 字节小端的请求长度、请求和完整的响应
+  // 流进行承诺，而不是对 wrap() 的结果
+  const bool streaming;
+  wc_Sha512 stream_sha;
+  unsigned char stream_digest[SHA512_BATCH_DIGEST_SIZE];
+  // 尚未交给 App 的明文，不超过 STREAM_CHUNK_SIZE 加一次读取的长度
+  std::string stream_buffer;
+  // 已经交给 App 的长度
+  size_t streamed_size = 0;
+  // 正在解析的响应头，字段名和值都可能分多次回调
+  std::string header_field;
+  std::string header_value;
+  bool reading_header_value = false;
+  // Content-Encoding 为 gzip 或 deflate 时创建，边接收边解压响应体，
+  // 解压后的长度受 MAX_RESPONSE_SIZE 限制（流式模式不解压）
+  std::unique_ptr<Inflater> inflater;
+  // http_parser 回调或 Http2Connection 中出现的错误，由 read() 或 work() 返回
+  StatusCode parse_status = StatusCode::Success;
+  // HTTP/2 模式：请求作为 connection 的一个 stream 发出，Client 不直接收发，
+  // 由 connection 交付响应头和响应体（不支持流式模式）
+  const bool http2;
+  // 所在的连接，连接先被释放时置为空指针
+  Http2Connection *connection;
 
   // 发起握手连接，非阻塞，需要重复调用直到返回 StatusCode::Success
   StatusCode connect() const;
@@ -53,36 +91,82 @@ class Client {
   // 重复从 socket 中进行读取，直到 socket 被阻塞
   StatusCode read();
 
-  // 根据错误代码，打印 WolfSSL 的错误信息
-  const char *get_wolfssl_error_str(int err) const;
+  // 流式模式下的 read()，响应完整时计算出 stream_digest
+  StatusCode read_stream();
+
+  // 将 stream_buffer 通过 o_stream 交给 App
+  void flush_stream();
 
   // 初始化 http_parser，在消息结束时置 response_complete = true
   void init_parser();
 
+  // http_parser 的回调，通过 parser->data 找到对应的 Client
+  static int on_message_complete(http_parser *parser);
+  static int on_status(http_parser *parser, const char *at, size_t length);
+  static int on_header_field(http_parser *parser, const char *at,
+                             size_t length);
+  static int on_header_value(http_parser *parser, const char *at,
+                             size_t length);
+  static int on_headers_complete(http_parser *parser);
+  static int on_body(http_parser *parser, const char *at, size_t length);
+  static int on_chunk_header(http_parser *parser);
+
+  // 在 headers 中写入状态行的版本和状态码，原因短语由 on_status 追加
+  void begin_headers();
+
+  // 为响应体预留 size 字节，超过 MAX_RESPONSE_SIZE 时返回 false
+  bool reserve_body(uint64_t size);
+
+  // 处理一个完整的响应头，存入 headers，并根据 Content-Encoding 创建 inflater
+  void end_header();
+
+  // 响应头结束，content_length 未知时为 ULLONG_MAX，出错时返回 false
+  bool finish_headers(uint64_t content_length);
+
+  // 追加一段响应体，出错时设置 parse_status 并返回 false
+  bool receive_body(const char *at, size_t length);
+
+  // HTTP/2 的响应头，按与 HTTP/1.1 相同的格式存入 headers，出错时返回 false
+  bool receive_http2_headers(const std::vector<HeaderField> &fields);
+
+  // 由 Http2Connection 在 stream 结束时调用，之后 work() 返回结果或错误
+  void finish_http2(StatusCode status);
+
+  // HTTP/2 模式下的 work()，IO 由 Http2Connection 完成，这里只检查进度
+  StatusCode work_http2();
+
   // 打包一个用于生成 quote 的数据，包含所有必要信息
   std::string wrap() const;
 
  public:
-  Client(const std::string &hostname, std::string &&request, int id);
-
-  // 禁止 copy 和 move
-  Client(const Client &) = delete;
-  Client(Client &&) = delete;
-  Client operator=(const Client &) = delete;
-  Client operator=(Client &&) = delete;
+  // connection 非空时使用 HTTP/2 模式
+  Client(const std::string &hostname, std::string &&request, int id,
+         bool streaming, Http2Connection *connection = nullptr);
 
   // 对应 socket 准备好时调用，继续进行一步操作，当 IO 再次等待时返回
-  // 仅当全部流程处理完时返回 StatusCode::Success，否则返回 StatusCode::Blocking
-  // 或错误代码
+  // 仅当全部流程处理完时返回 StatusCode::Success；响应接收完、等待生成 report
+  // 时返回 StatusCode::Quoting；内存紧张而暂停读取时返回 StatusCode::Throttled；
+  // 否则返回 StatusCode::Blocking 或错误代码
   StatusCode work();
+
+  // 将当前在 Enclave 堆中的占用更新到 memory_accountant，每次 work() 后调用
+  void account();
+
+  // 由 e_quote_batch 计算打包数据的 hash 后调用，生成 report
+  void create_report(const unsigned char *sha_sum);
+
+  State get_state() const { return state; }
+  const std::string &get_hostname() const { return hostname; }
+  bool is_streaming() const { return streaming; }
+  // 流式模式下响应完整后有效
+  const unsigned char *get_stream_digest() const { return stream_digest; }
   const std::string &get_response() const { return response; }
   const sgx_report_t &get_report() const { return report; }
 
-  // 释放 ssl 对象
+  // 从 Http2Connection 和 memory_accountant 中移除
   ~Client();
 
-  friend int recv_callback(WOLFSSL *, char *buffer, int size, void *ctx);
-  friend int send_callback(WOLFSSL *, char *buffer, int size, void *ctx);
+  friend class Http2Connection;
 };
 
 #endif  // _E_CLIENT_H_
\ No newline at end of file
@@ -0,0 +1,341 @@
+// HPACK 的解码和简单编码，见 RFC 7541
+#include "Hpack.h"
+#include <stdint.h>
+
+// 附录 A 的静态表
+static const char *const static_table[61][2] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+// 附录 B 的 Huffman 编码，第 256 项为 EOS
+static const uint32_t huffman_codes[257] = {
+    0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6,
+    0xfffffe7, 0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea,
+    0x3ffffffd, 0xfffffeb, 0xfffffec, 0xfffffed, 0xfffffee, 0xfffffef,
+    0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3, 0xffffff4,
+    0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+    0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa, 0x3fa, 0x3fb, 0xf9,
+    0x7fb, 0xfa, 0x16, 0x17, 0x18, 0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+    0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc, 0x1ffa, 0x21, 0x5d,
+    0x5e, 0x5f, 0x60, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72, 0xfc, 0x73, 0xfd,
+    0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22, 0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5,
+    0x25, 0x26, 0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7, 0x2b, 0x76, 0x2c,
+    0x8, 0x9, 0x2d, 0x77, 0x78, 0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd,
+    0xffffffc, 0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4,
+    0x3fffd5, 0x7fffd9, 0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd,
+    0x7fffde, 0xffffeb, 0x7fffdf, 0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0,
+    0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3, 0x7fffe4, 0x1fffdc, 0x3fffd8,
+    0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef, 0x3fffda, 0x1fffdd,
+    0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde, 0x7fffea,
+    0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+    0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee,
+    0x7fffef, 0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5,
+    0x3fffe6, 0x7ffff1, 0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7,
+    0x7ffff2, 0x3fffe8, 0x1ffffec, 0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde,
+    0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed, 0x7fff2, 0x1fffe3, 0x3ffffe6,
+    0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2, 0x1fffe4, 0x1fffe5,
+    0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5, 0xfffec,
+    0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+    0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea,
+    0x7ffff4, 0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8,
+    0x7ffffe9, 0x7ffffea, 0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee,
+    0x7ffffef, 0x7fffff0, 0x3ffffee, 0x3fffffff
+};
+static const uint8_t huffman_lengths[257] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28, 28, 28, 28,
+    28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28, 6, 10, 10, 12, 13, 6, 8,
+    11, 10, 10, 8, 11, 8, 6, 6, 6, 5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6,
+    12, 10, 13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 8, 7, 8, 13, 19, 13, 14, 6, 15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6,
+    6, 5, 6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28, 20, 22, 20, 20,
+    22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23, 24, 24, 22, 23, 24, 23, 23,
+    23, 23, 21, 22, 23, 22, 23, 23, 24, 22, 21, 20, 22, 22, 23, 23, 21, 23, 22,
+    22, 24, 21, 22, 23, 23, 21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23,
+    22, 22, 23, 26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27, 20, 24, 20,
+    21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23, 26, 27, 26, 26, 27, 27,
+    27, 27, 27, 28, 27, 27, 27, 27, 27, 26, 30
+};
+
+
+// Huffman 解码树，第一次使用时由编码表构造
+// 每个内部节点有两个子节点：正数为内部节点，负数为符号 -(symbol + 1)，
+// 0 表示不存在的编码
+typedef int16_t HuffmanNode[2];
+static const HuffmanNode *huffman_tree() {
+  static const HuffmanNode *tree = [] {
+    static HuffmanNode nodes[256] = {};
+    int count = 1;
+    for (int symbol = 0; symbol < 257; symbol++) {
+      auto code = huffman_codes[symbol];
+      int node = 0;
+      for (int bit = huffman_lengths[symbol] - 1; bit > 0; bit--) {
+        auto &child = nodes[node][(code >> bit) & 1];
+        if (child == 0) {
+          child = (int16_t)count++;
+        }
+        node = child;
+      }
+      nodes[node][code & 1] = (int16_t)-(symbol + 1);
+    }
+    return (const HuffmanNode *)nodes;
+  }();
+  return tree;
+}
+
+// Huffman 解码，末尾的填充必须是少于 8 位的 EOS 前缀（全为 1）
+static bool huffman_decode(const unsigned char *data, size_t size,
+                           std::string &out) {
+  auto tree = huffman_tree();
+  int node = 0;
+  int depth = 0;
+  bool all_ones = true;
+  for (size_t i = 0; i < size; i++) {
+    for (int bit = 7; bit >= 0; bit--) {
+      auto b = (data[i] >> bit) & 1;
+      auto next = tree[node][b];
+      depth += 1;
+      all_ones = all_ones && b;
+      if (next < 0) {
+        if (next == -257) {
+          // 不允许出现 EOS
+          return false;
+        }
+        out.push_back((char)(-next - 1));
+        node = 0;
+        depth = 0;
+        all_ones = true;
+      } else if (next == 0) {
+        return false;
+      } else {
+        node = next;
+      }
+    }
+  }
+  return depth < 8 && all_ones;
+}
+
+// 读取 prefix 位前缀的整数，超过 2^28 视为错误
+static bool read_integer(const unsigned char *&p, const unsigned char *end,
+                         int prefix, size_t &value) {
+  if (p == end) {
+    return false;
+  }
+  size_t max = ((size_t)1 << prefix) - 1;
+  value = *p++ & max;
+  if (value < max) {
+    return true;
+  }
+  for (int shift = 0; p < end && shift <= 21; shift += 7) {
+    auto b = *p++;
+    value += (size_t)(b & 0x7f) << shift;
+    if (!(b & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// 读取字符串字面量，最高位表示是否为 Huffman 编码
+static bool read_string(const unsigned char *&p, const unsigned char *end,
+                        std::string &out) {
+  if (p == end) {
+    return false;
+  }
+  bool huffman = *p & 0x80;
+  size_t length;
+  if (!read_integer(p, end, 7, length) || (size_t)(end - p) < length) {
+    return false;
+  }
+  if (huffman) {
+    if (!huffman_decode(p, length, out)) {
+      return false;
+    }
+  } else {
+    out.assign((const char *)p, length);
+  }
+  p += length;
+  return true;
+}
+
+// 按索引查找，1 至 61 为静态表，之后为动态表
+bool HpackDecoder::lookup(size_t index, HeaderField &field) const {
+  if (index == 0) {
+    return false;
+  } else if (index <= 61) {
+    field.first = static_table[index - 1][0];
+    field.second = static_table[index - 1][1];
+    return true;
+  } else if (index - 62 < dynamic_table.size()) {
+    field = dynamic_table[index - 62];
+    return true;
+  }
+  return false;
+}
+
+// 加入动态表，并淘汰超出大小的旧项
+void HpackDecoder::insert(const HeaderField &field) {
+  dynamic_table.push_front(field);
+  table_size += 32 + field.first.size() + field.second.size();
+  evict();
+}
+
+// 淘汰旧项直到 table_size 不超过 max_table_size
+void HpackDecoder::evict() {
+  while (table_size > max_table_size) {
+    auto &field = dynamic_table.back();
+    table_size -= 32 + field.first.size() + field.second.size();
+    dynamic_table.pop_back();
+  }
+}
+
+// 解码一个完整的 header block，追加到 fields，格式错误或解码后的大小
+// （按 RFC 7540 6.5.2 计算）超过 max_list_size 时返回 false，之后整个连接
+// 都不能再使用
+// 引用动态表的字段只占一个字节，却可以解码出接近 4KB，必须按解码后的
+// 大小限制，而不只是 header block 的长度
+bool HpackDecoder::decode(const std::string &block,
+                          std::vector<HeaderField> &fields,
+                          size_t max_list_size) {
+  auto p = (const unsigned char *)block.data();
+  auto end = p + block.size();
+  size_t list_size = 0;
+  while (p < end) {
+    auto first = *p;
+    size_t index;
+    if (first & 0x80) {
+      // 索引的字段
+      HeaderField field;
+      if (!read_integer(p, end, 7, index) || !lookup(index, field)) {
+        return false;
+      }
+      list_size += 32 + field.first.size() + field.second.size();
+      if (list_size > max_list_size) {
+        return false;
+      }
+      fields.push_back(std::move(field));
+    } else if ((first & 0xe0) == 0x20) {
+      // 动态表大小更新，不能超过默认的 SETTINGS_HEADER_TABLE_SIZE
+      if (!read_integer(p, end, 5, index) || index > 4096) {
+        return false;
+      }
+      max_table_size = index;
+      evict();
+    } else {
+      // 字面量：0x40 加入索引，0x00 不加入索引，0x10 永不索引
+      bool indexing = first & 0x40;
+      HeaderField field;
+      if (!read_integer(p, end, indexing ? 6 : 4, index)) {
+        return false;
+      }
+      if (index == 0) {
+        if (!read_string(p, end, field.first)) {
+          return false;
+        }
+      } else if (!lookup(index, field)) {
+        return false;
+      }
+      field.second.clear();
+      if (!read_string(p, end, field.second)) {
+        return false;
+      }
+      if (indexing) {
+        insert(field);
+      }
+      list_size += 32 + field.first.size() + field.second.size();
+      if (list_size > max_list_size) {
+        return false;
+      }
+      fields.push_back(std::move(field));
+    }
+  }
+  return true;
+}
+
+// 写入 prefix 位前缀的整数，first 为第一个字节中前缀之外的标志位
+static void write_integer(std::string &block, unsigned char first, int prefix,
+                          size_t value) {
+  size_t max = ((size_t)1 << prefix) - 1;
+  if (value < max) {
+    block.push_back((char)(first | value));
+    return;
+  }
+  block.push_back((char)(first | max));
+  value -= max;
+  while (value >= 128) {
+    block.push_back((char)(value % 128 + 128));
+    value /= 128;
+  }
+  block.push_back((char)value);
+}
+
+// 以不加入索引的字面量编码一个字段，追加到 block，不使用 Huffman 编码
+void hpack_encode(std::string &block, const std::string &name,
+                  const std::string &value) {
+  block.push_back(0);
+  write_integer(block, 0, 7, name.size());
+  block.append(name);
+  write_integer(block, 0, 7, value.size());
+  block.append(value);
+}
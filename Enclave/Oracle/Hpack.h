@@ -0,0 +1,45 @@
+#ifndef _E_HPACK_H_
+#define _E_HPACK_H_
+
+#include <stddef.h>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+// HTTP/2 的头部字段，名称为小写
+typedef std::pair<std::string, std::string> HeaderField;
+
+// HPACK（RFC 7541）解码，每个 HTTP/2 连接一个，动态表在连接的所有 stream
+// 之间共享，因此每个 header block 都必须按顺序解码
+class HpackDecoder {
+ protected:
+  // 动态表，新加入的在前
+  std::deque<HeaderField> dynamic_table;
+  // 动态表按 RFC 计算的大小（每项 32 字节加名称和值的长度）
+  size_t table_size = 0;
+  // 动态表大小上限，对方可以通过 size update 在 SETTINGS 允许的范围内调整
+  size_t max_table_size = 4096;
+
+  // 按索引查找，1 至 61 为静态表，之后为动态表
+  bool lookup(size_t index, HeaderField &field) const;
+
+  // 加入动态表，并淘汰超出大小的旧项
+  void insert(const HeaderField &field);
+
+  // 淘汰旧项直到 table_size 不超过 max_table_size
+  void evict();
+
+ public:
+  // 解码一个完整的 header block，追加到 fields，格式错误或解码后的大小
+  // （按 RFC 7540 6.5.2 计算）超过 max_list_size 时返回 false，之后整个连接
+  // 都不能再使用
+  bool decode(const std::string &block, std::vector<HeaderField> &fields,
+              size_t max_list_size);
+};
+
+// 以不加入索引的字面量编码一个字段，追加到 block，不使用 Huffman 编码
+void hpack_encode(std::string &block, const std::string &name,
+                  const std::string &value);
+
+#endif  // _E_HPACK_H_
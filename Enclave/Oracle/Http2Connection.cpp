@@ -0,0 +1,661 @@
+// HTTP/2 客户端连接，多个 Client 作为 stream 共用一个 TLS session
+#include "Http2Connection.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "Client.h"
+#include "Enclave/Enclave_t.h"
+#include "MemoryAccountant.h"
+#include "Shared/Config.h"
+#include "Shared/Logging.h"
+#include "Snapshot.h"
+
+// 帧类型
+const uint8_t FRAME_DATA = 0x0;
+const uint8_t FRAME_HEADERS = 0x1;
+const uint8_t FRAME_RST_STREAM = 0x3;
+const uint8_t FRAME_SETTINGS = 0x4;
+const uint8_t FRAME_PUSH_PROMISE = 0x5;
+const uint8_t FRAME_PING = 0x6;
+const uint8_t FRAME_GOAWAY = 0x7;
+const uint8_t FRAME_WINDOW_UPDATE = 0x8;
+const uint8_t FRAME_CONTINUATION = 0x9;
+// 帧标志
+const uint8_t FLAG_END_STREAM = 0x1;
+const uint8_t FLAG_ACK = 0x1;
+const uint8_t FLAG_END_HEADERS = 0x4;
+const uint8_t FLAG_PADDED = 0x8;
+const uint8_t FLAG_PRIORITY = 0x20;
+// SETTINGS 参数
+const uint16_t SETTINGS_ENABLE_PUSH = 0x2;
+const uint16_t SETTINGS_MAX_CONCURRENT_STREAMS = 0x3;
+const uint16_t SETTINGS_INITIAL_WINDOW_SIZE = 0x4;
+const uint16_t SETTINGS_MAX_FRAME_SIZE = 0x5;
+const uint16_t SETTINGS_MAX_HEADER_LIST_SIZE = 0x6;
+// RST_STREAM 的错误代码
+const uint32_t ERROR_PROTOCOL = 0x1;
+const uint32_t ERROR_FLOW_CONTROL = 0x3;
+const uint32_t ERROR_CANCEL = 0x8;
+// 对方在 SETTINGS 之前允许的流量控制窗口
+const uint32_t DEFAULT_WINDOW_SIZE = 65535;
+// 流量控制窗口的上限（RFC 7540 6.9.1）
+const int64_t MAX_WINDOW_SIZE = 0x7fffffff;
+// SETTINGS_MAX_FRAME_SIZE 的有效范围（RFC 7540 6.5.2）
+const uint32_t MIN_MAX_FRAME_SIZE = 1 << 14;
+const uint32_t MAX_MAX_FRAME_SIZE = (1 << 24) - 1;
+
+static void put_u16(std::string &out, uint16_t value) {
+  out.push_back((char)(value >> 8));
+  out.push_back((char)value);
+}
+
+static void put_u32(std::string &out, uint32_t value) {
+  put_u16(out, (uint16_t)(value >> 16));
+  put_u16(out, (uint16_t)value);
+}
+
+static uint32_t get_u32(const char *p) {
+  auto u = (const unsigned char *)p;
+  return (uint32_t)u[0] << 24 | (uint32_t)u[1] << 16 | (uint32_t)u[2] << 8 |
+         u[3];
+}
+
+// 将 HTTP/1.1 格式的请求转换为 HTTP/2 的 header block 和请求体
+// Host 转换为 :authority，去掉 HTTP/2 不允许的连接相关字段
+static bool encode_request(const std::string &request,
+                           const std::string &hostname, std::string &block,
+                           std::string &body) {
+  auto line_end = request.find("\r\n");
+  auto head_end = request.find("\r\n\r\n");
+  auto first = request.find(' ');
+  auto second = request.find(' ', first + 1);
+  if (head_end == std::string::npos || second == std::string::npos ||
+      second > line_end) {
+    return false;
+  }
+  auto authority = hostname;
+  std::string fields;
+  auto content_length = std::string::npos;
+  for (auto pos = line_end + 2; pos < head_end + 2;) {
+    auto end = request.find("\r\n", pos);
+    auto colon = request.find(':', pos);
+    if (colon > end) {
+      return false;
+    }
+    auto name = request.substr(pos, colon - pos);
+    for (auto &c : name) {
+      c = (char)tolower((unsigned char)c);
+    }
+    auto value_begin = request.find_first_not_of(" \t", colon + 1);
+    auto value = value_begin < end
+                     ? request.substr(value_begin, end - value_begin)
+                     : std::string();
+    pos = end + 2;
+    if (name == "host") {
+      authority = value;
+    } else if (name == "connection" || name == "keep-alive" ||
+               name == "proxy-connection" || name == "transfer-encoding" ||
+               name == "upgrade" || name == "te") {
+      continue;
+    } else {
+      if (name == "content-length") {
+        content_length = (size_t)strtoull(value.c_str(), nullptr, 10);
+      }
+      hpack_encode(fields, name, value);
+    }
+  }
+  // 伪头部必须在其他字段之前
+  hpack_encode(block, ":method", request.substr(0, first));
+  hpack_encode(block, ":scheme", "https");
+  hpack_encode(block, ":authority", authority);
+  hpack_encode(block, ":path", request.substr(first + 1, second - first - 1));
+  block.append(fields);
+  body = request.substr(head_end + 4);
+  if (content_length < body.size()) {
+    body.resize(content_length);
+  }
+  return true;
+}
+
+Http2Connection::Http2Connection(const std::string &hostname, int id)
+    : TlsSocket(id, true), hostname(hostname) {
+  wolfSSL_check_domain_name(ssl, hostname.c_str());
+  wolfSSL_SetServerID(ssl, (const unsigned char *)hostname.data(),
+                      (int)hostname.size(), 0);
+#ifdef HAVE_SNI
+  wolfSSL_UseSNI(ssl, WOLFSSL_SNI_HOST_NAME, hostname.data(),
+                 (unsigned short)hostname.size());
+#endif
+#ifdef HAVE_ALPN
+  char protocol[] = "h2";
+  wolfSSL_UseALPN(ssl, protocol, sizeof(protocol) - 1,
+                  WOLFSSL_ALPN_FAILED_ON_MISMATCH);
+#endif
+  account();
+}
+
+// 握手并检查 ALPN 协商的结果，成功后写入连接前言和 SETTINGS
+StatusCode Http2Connection::connect() {
+#ifdef HAVE_ALPN
+  auto status = parse_wolfssl_status(wolfSSL_connect(ssl));
+  if (status != StatusCode::Success) {
+    return status;
+  }
+  char *protocol = nullptr;
+  unsigned short protocol_size = 0;
+  if (wolfSSL_ALPN_GetProtocol(ssl, &protocol, &protocol_size) !=
+          SSL_SUCCESS ||
+      protocol_size != 2 || memcmp(protocol, "h2", 2) != 0) {
+    ERROR("Connection %d: %s does not support HTTP/2", id, hostname.c_str());
+    return StatusCode::LibraryError;
+  }
+#else
+  ERROR("HTTP/2 requires WolfSSL built with HAVE_ALPN");
+  return StatusCode::LibraryError;
+#endif
+  auto &stats = host_stats[hostname];
+  stats.connections += 1;
+  if (wolfSSL_session_reused(ssl)) {
+    stats.resumed += 1;
+  }
+  LOG("HTTP/2 connection %d to %s opened", id, hostname.c_str());
+  output.append("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n");
+  std::string settings;
+  put_u16(settings, SETTINGS_ENABLE_PUSH);
+  put_u32(settings, 0);
+  put_u16(settings, SETTINGS_INITIAL_WINDOW_SIZE);
+  put_u32(settings, HTTP2_WINDOW_SIZE);
+  // 解码后的响应头与 HTTP/1.1 使用相同的上限，process_headers 中强制执行
+  put_u16(settings, SETTINGS_MAX_HEADER_LIST_SIZE);
+  put_u32(settings, HTTP_MAX_HEADER_SIZE);
+  write_frame(FRAME_SETTINGS, 0, 0, settings.data(), settings.size());
+  // 连接级的窗口只能通过 WINDOW_UPDATE 扩大
+  std::string increment;
+  put_u32(increment, HTTP2_WINDOW_SIZE - DEFAULT_WINDOW_SIZE);
+  write_frame(FRAME_WINDOW_UPDATE, 0, 0, increment.data(), increment.size());
+  state = Open;
+  return StatusCode::Success;
+}
+
+// 追加一个帧到 output
+void Http2Connection::write_frame(uint8_t type, uint8_t flags,
+                                  uint32_t stream_id, const char *payload,
+                                  size_t size) {
+  output.push_back((char)(size >> 16));
+  put_u16(output, (uint16_t)size);
+  output.push_back((char)type);
+  output.push_back((char)flags);
+  put_u32(output, stream_id);
+  output.append(payload, size);
+}
+
+// 将 output 写入 WolfSSL 并发送
+StatusCode Http2Connection::write() {
+  while (!output.empty()) {
+    auto size = std::min(output.size(), (size_t)SOCKET_SEND_BUFFER_SIZE);
+    auto ret = wolfSSL_write(ssl, output.data(), (int)size);
+    if (ret <= 0) {
+      // 阻塞时 WolfSSL 保留已加密的记录，之后以相同的数据重试
+      return parse_wolfssl_status(ret);
+    }
+    output.erase(0, (size_t)ret);
+  }
+  auto status = flush();
+  return status.is_error() ? status : StatusCode(StatusCode::Success);
+}
+
+// 为等待中的 Client 打开 stream，不超过对方允许的并发数，之后发送窗口
+// 允许的请求体
+void Http2Connection::open_streams() {
+  while (state == Open && !going_away && !waiting.empty() &&
+         streams.size() < max_concurrent_streams) {
+    auto client = waiting.front();
+    waiting.pop_front();
+    std::string block, body;
+    if (!encode_request(client->request, hostname, block, body)) {
+      ERROR("Client %d: request cannot be sent over HTTP/2", client->id);
+      client->finish_http2(StatusCode::ParserError);
+      o_ready(client->id);
+      continue;
+    }
+    auto stream_id = next_stream_id;
+    next_stream_id += 2;
+    // header block 超过帧长度时，之后的部分放在 CONTINUATION 中
+    for (size_t pos = 0; pos == 0 || pos < block.size();) {
+      auto size = std::min(block.size() - pos, (size_t)max_frame_size);
+      uint8_t flags = pos + size == block.size() ? FLAG_END_HEADERS : 0;
+      if (pos == 0 && body.empty()) {
+        flags |= FLAG_END_STREAM;
+      }
+      write_frame(pos == 0 ? FRAME_HEADERS : FRAME_CONTINUATION, flags,
+                  stream_id, block.data() + pos, size);
+      pos += size;
+    }
+    streams[stream_id] = {client, 0, initial_send_window, std::move(body), 0};
+    client->state = Client::Reading;
+  }
+  send_bodies();
+}
+
+// 在连接和各 stream 的发送窗口内发送剩余的请求体，其余的等待
+// WINDOW_UPDATE
+void Http2Connection::send_bodies() {
+  for (auto &pair : streams) {
+    auto &stream = pair.second;
+    while (stream.body_sent < stream.body.size() && stream.send_window > 0 &&
+           connection_send_window > 0) {
+      auto size = std::min({stream.body.size() - stream.body_sent,
+                            (size_t)max_frame_size, (size_t)stream.send_window,
+                            (size_t)connection_send_window});
+      stream.body_sent += size;
+      auto done = stream.body_sent == stream.body.size();
+      write_frame(FRAME_DATA, done ? FLAG_END_STREAM : 0, pair.first,
+                  stream.body.data() + stream.body_sent - size, size);
+      stream.send_window -= (int64_t)size;
+      connection_send_window -= (int64_t)size;
+      if (done) {
+        std::string().swap(stream.body);
+        stream.body_sent = 0;
+      }
+    }
+    if (connection_send_window <= 0) {
+      return;
+    }
+  }
+}
+
+// 读取所有可用的明文并处理其中完整的帧
+StatusCode Http2Connection::read() {
+  char buffer[SOCKET_READ_SIZE];
+  while (state == Open) {
+    auto ret = wolfSSL_read(ssl, buffer, SOCKET_READ_SIZE);
+    if (ret <= 0) {
+      return parse_wolfssl_status(ret);
+    }
+    input.append(buffer, (size_t)ret);
+    size_t pos = 0;
+    while (input.size() - pos >= 9) {
+      auto p = input.data() + pos;
+      auto size = (uint32_t)(unsigned char)p[0] << 16 |
+                  (uint32_t)(unsigned char)p[1] << 8 | (unsigned char)p[2];
+      // 未修改 SETTINGS_MAX_FRAME_SIZE，帧不能超过默认的 16KB
+      if (size > 1 << 14) {
+        ERROR("Connection %d: frame too large", id);
+        return StatusCode::LibraryError;
+      }
+      if (input.size() - pos < 9 + size) {
+        break;
+      }
+      auto status = process_frame((uint8_t)p[3], (uint8_t)p[4],
+                                  get_u32(p + 5) & 0x7fffffff, p + 9, size);
+      if (status.is_error()) {
+        return status;
+      }
+      pos += 9 + size;
+    }
+    input.erase(0, pos);
+  }
+  return StatusCode::Success;
+}
+
+// 处理一个完整的帧，返回错误时关闭整个连接
+StatusCode Http2Connection::process_frame(uint8_t type, uint8_t flags,
+                                          uint32_t stream_id,
+                                          const char *payload, size_t size) {
+  // header block 必须连续，中间不能有其他帧
+  if (header_stream != 0 && type != FRAME_CONTINUATION) {
+    return StatusCode::LibraryError;
+  }
+  // DATA 和 HEADERS 的填充
+  size_t padding = 0;
+  if ((type == FRAME_DATA || type == FRAME_HEADERS) && (flags & FLAG_PADDED)) {
+    if (size == 0 || (unsigned char)payload[0] >= size) {
+      return StatusCode::LibraryError;
+    }
+    padding = (unsigned char)payload[0];
+    payload += 1;
+    size -= 1 + padding;
+  }
+  switch (type) {
+    case FRAME_DATA: {
+      if (stream_id == 0) {
+        return StatusCode::LibraryError;
+      }
+      // 连接级的窗口包括填充，使用过半时一次性归还
+      connection_received += (uint32_t)(size + padding + (padding ? 1 : 0));
+      if (connection_received >= HTTP2_WINDOW_SIZE / 2) {
+        std::string increment;
+        put_u32(increment, connection_received);
+        write_frame(FRAME_WINDOW_UPDATE, 0, 0, increment.data(),
+                    increment.size());
+        connection_received = 0;
+      }
+      auto it = streams.find(stream_id);
+      if (it == streams.end()) {
+        // 已经结束的 stream
+        return StatusCode::Success;
+      }
+      auto &client = *it->second.client;
+      if (!client.receive_body(payload, size)) {
+        std::string code;
+        put_u32(code, ERROR_CANCEL);
+        write_frame(FRAME_RST_STREAM, 0, stream_id, code.data(), code.size());
+        close_stream(stream_id, client.parse_status);
+      } else if (flags & FLAG_END_STREAM) {
+        close_stream(stream_id, StatusCode::Success);
+      } else {
+        auto &received = it->second.received;
+        received += (uint32_t)(size + padding + (padding ? 1 : 0));
+        if (received >= HTTP2_WINDOW_SIZE / 2) {
+          std::string increment;
+          put_u32(increment, received);
+          write_frame(FRAME_WINDOW_UPDATE, 0, stream_id, increment.data(),
+                      increment.size());
+          received = 0;
+        }
+      }
+      return StatusCode::Success;
+    }
+    case FRAME_HEADERS: {
+      if (stream_id == 0) {
+        return StatusCode::LibraryError;
+      }
+      // 不使用优先级，跳过依赖和权重
+      if (flags & FLAG_PRIORITY) {
+        if (size < 5) {
+          return StatusCode::LibraryError;
+        }
+        payload += 5;
+        size -= 5;
+      }
+      header_stream = stream_id;
+      header_end_stream = flags & FLAG_END_STREAM;
+      header_block.assign(payload, size);
+      if (flags & FLAG_END_HEADERS) {
+        return process_headers();
+      }
+      return StatusCode::Success;
+    }
+    case FRAME_CONTINUATION: {
+      if (header_stream == 0 || stream_id != header_stream) {
+        return StatusCode::LibraryError;
+      }
+      // 与 HTTP/1.1 的响应头使用相同的上限，防止 CONTINUATION 无限累积
+      if (header_block.size() + size > HTTP_MAX_HEADER_SIZE) {
+        ERROR("Connection %d: header block too large", id);
+        return StatusCode::LibraryError;
+      }
+      header_block.append(payload, size);
+      if (flags & FLAG_END_HEADERS) {
+        return process_headers();
+      }
+      return StatusCode::Success;
+    }
+    case FRAME_RST_STREAM: {
+      LOG("Connection %d: stream %u reset by peer", id, stream_id);
+      close_stream(stream_id, StatusCode::LibraryError);
+      return StatusCode::Success;
+    }
+    case FRAME_SETTINGS: {
+      if (flags & FLAG_ACK) {
+        return StatusCode::Success;
+      }
+      if (stream_id != 0 || size % 6 != 0) {
+        return StatusCode::LibraryError;
+      }
+      for (size_t i = 0; i < size; i += 6) {
+        auto key = (uint16_t)((unsigned char)payload[i] << 8 |
+                              (unsigned char)payload[i + 1]);
+        auto value = get_u32(payload + i + 2);
+        if (key == SETTINGS_MAX_CONCURRENT_STREAMS) {
+          max_concurrent_streams = value;
+        } else if (key == SETTINGS_MAX_FRAME_SIZE) {
+          // 超出范围是连接错误，为 0 时 open_streams 无法拆分 header block
+          if (value < MIN_MAX_FRAME_SIZE || value > MAX_MAX_FRAME_SIZE) {
+            ERROR("Connection %d: invalid SETTINGS_MAX_FRAME_SIZE %u", id,
+                  value);
+            return StatusCode::LibraryError;
+          }
+          max_frame_size = value;
+        } else if (key == SETTINGS_INITIAL_WINDOW_SIZE) {
+          // 变化量作用于所有已打开的 stream（RFC 7540 6.9.2），超出上限是
+          // 连接错误
+          if (value > MAX_WINDOW_SIZE) {
+            ERROR("Connection %d: invalid SETTINGS_INITIAL_WINDOW_SIZE %u", id,
+                  value);
+            return StatusCode::LibraryError;
+          }
+          auto delta = (int64_t)value - initial_send_window;
+          for (auto &pair : streams) {
+            pair.second.send_window += delta;
+            if (pair.second.send_window > MAX_WINDOW_SIZE) {
+              return StatusCode::LibraryError;
+            }
+          }
+          initial_send_window = value;
+        }
+      }
+      write_frame(FRAME_SETTINGS, FLAG_ACK, 0, nullptr, 0);
+      return StatusCode::Success;
+    }
+    case FRAME_PUSH_PROMISE: {
+      // SETTINGS_ENABLE_PUSH 为 0，对方不能推送
+      return StatusCode::LibraryError;
+    }
+    case FRAME_PING: {
+      if (!(flags & FLAG_ACK)) {
+        write_frame(FRAME_PING, FLAG_ACK, 0, payload, size);
+      }
+      return StatusCode::Success;
+    }
+    case FRAME_GOAWAY: {
+      if (size < 8) {
+        return StatusCode::LibraryError;
+      }
+      // 编号更大的 stream 未被处理，以错误结束，由 App 重新提交
+      auto last_stream_id = get_u32(payload) & 0x7fffffff;
+      LOG("Connection %d: GOAWAY after stream %u", id, last_stream_id);
+      going_away = true;
+      std::vector<uint32_t> unprocessed;
+      for (auto &pair : streams) {
+        if (pair.first > last_stream_id) {
+          unprocessed.push_back(pair.first);
+        }
+      }
+      for (auto stream_id : unprocessed) {
+        close_stream(stream_id, StatusCode::LibraryError);
+      }
+      for (auto client : waiting) {
+        client->finish_http2(StatusCode::LibraryError);
+        o_ready(client->id);
+      }
+      waiting.clear();
+      return StatusCode::Success;
+    }
+    case FRAME_WINDOW_UPDATE: {
+      if (size != 4) {
+        return StatusCode::LibraryError;
+      }
+      auto increment = (int64_t)(get_u32(payload) & 0x7fffffff);
+      if (stream_id == 0) {
+        if (increment == 0 ||
+            connection_send_window + increment > MAX_WINDOW_SIZE) {
+          ERROR("Connection %d: invalid WINDOW_UPDATE", id);
+          return StatusCode::LibraryError;
+        }
+        connection_send_window += increment;
+        return StatusCode::Success;
+      }
+      auto it = streams.find(stream_id);
+      if (it == streams.end()) {
+        // 已经结束的 stream
+        return StatusCode::Success;
+      }
+      auto &send_window = it->second.send_window;
+      if (increment == 0 || send_window + increment > MAX_WINDOW_SIZE) {
+        // stream 错误，只结束该 stream
+        std::string code;
+        put_u32(code, increment == 0 ? ERROR_PROTOCOL : ERROR_FLOW_CONTROL);
+        write_frame(FRAME_RST_STREAM, 0, stream_id, code.data(), code.size());
+        close_stream(stream_id, StatusCode::LibraryError);
+        return StatusCode::Success;
+      }
+      send_window += increment;
+      return StatusCode::Success;
+    }
+    default: {
+      // PRIORITY 和未知类型的帧都可以忽略
+      return StatusCode::Success;
+    }
+  }
+}
+
+// 处理一个完整的 header block
+StatusCode Http2Connection::process_headers() {
+  auto stream_id = header_stream;
+  header_stream = 0;
+  // 动态表在所有 stream 间共享，即使 stream 已经结束也必须解码
+  std::vector<HeaderField> fields;
+  if (!hpack.decode(header_block, fields, HTTP_MAX_HEADER_SIZE)) {
+    ERROR("Connection %d: invalid or oversized header block", id);
+    return StatusCode::LibraryError;
+  }
+  header_block.clear();
+  auto it = streams.find(stream_id);
+  if (it == streams.end()) {
+    return StatusCode::Success;
+  }
+  auto &client = *it->second.client;
+  if (!fields.empty() && fields[0].first == ":status" &&
+      fields[0].second.compare(0, 1, "1") == 0) {
+    // 1xx 的临时响应
+    return StatusCode::Success;
+  }
+  // 响应头之后的 header block 为 trailer，不计入
+  if (!client.headers_complete && !client.receive_http2_headers(fields)) {
+    std::string code;
+    put_u32(code, ERROR_CANCEL);
+    write_frame(FRAME_RST_STREAM, 0, stream_id, code.data(), code.size());
+    close_stream(stream_id, client.parse_status);
+  } else if (header_end_stream) {
+    close_stream(stream_id, StatusCode::Success);
+  }
+  return StatusCode::Success;
+}
+
+// 结束一个 stream，status 为 StatusCode::Success 时表示响应完整
+void Http2Connection::close_stream(uint32_t stream_id, StatusCode status) {
+  auto it = streams.find(stream_id);
+  if (it == streams.end()) {
+    return;
+  }
+  auto client = it->second.client;
+  streams.erase(it);
+  client->finish_http2(status);
+  o_ready(client->id);
+}
+
+// 关闭连接，所有 Client 以 status 结束
+void Http2Connection::fail(StatusCode status) {
+  if (state == Closed) {
+    return;
+  }
+  state = Closed;
+  for (auto &pair : streams) {
+    pair.second.client->finish_http2(status);
+    o_ready(pair.second.client->id);
+  }
+  streams.clear();
+  for (auto client : waiting) {
+    client->finish_http2(status);
+    o_ready(client->id);
+  }
+  waiting.clear();
+}
+
+// Client 创建时加入等待队列，连接打开后为其打开 stream
+void Http2Connection::attach(Client *client) {
+  clients.insert(client);
+  if (state == Closed || going_away) {
+    client->finish_http2(StatusCode::LibraryError);
+    return;
+  }
+  waiting.push_back(client);
+  if (state == Open) {
+    // 连接空闲时没有 socket 事件，需要在这里发出请求
+    open_streams();
+    auto status = write();
+    if (status.is_error()) {
+      fail(status);
+    }
+  }
+}
+
+// Client 释放时调用，之后不再访问该 Client
+void Http2Connection::detach(Client *client) {
+  clients.erase(client);
+  waiting.erase(std::remove(waiting.begin(), waiting.end(), client),
+                waiting.end());
+  for (auto it = streams.begin(); it != streams.end(); it++) {
+    if (it->second.client == client) {
+      // 超时等原因提前释放，通知对方不再发送
+      std::string code;
+      put_u32(code, ERROR_CANCEL);
+      write_frame(FRAME_RST_STREAM, 0, it->first, code.data(), code.size());
+      streams.erase(it);
+      break;
+    }
+  }
+}
+
+// 对应 socket 准备好时调用，连接正常时返回 StatusCode::Blocking，
+// 否则返回错误代码，之后 App 应当移除该连接
+StatusCode Http2Connection::work() {
+  if (state == Connecting) {
+    auto status = connect();
+    if (status == StatusCode::Blocking) {
+      return status;
+    } else if (status.is_error()) {
+      fail(status);
+      return status;
+    }
+  }
+  auto status = read();
+  if (status == StatusCode::Success || status == StatusCode::Blocking) {
+    open_streams();
+    status = write();
+  }
+  if (status.is_error()) {
+    fail(status);
+    return status;
+  }
+  if (state == Closed || (going_away && streams.empty())) {
+    // 对方关闭了连接，之后的任务使用新的连接
+    fail(StatusCode::LibraryError);
+    return StatusCode::LibraryError;
+  }
+  return StatusCode::Blocking;
+}
+
+// 将当前在 Enclave 堆中的占用更新到 memory_accountant，每次 work() 后调用
+void Http2Connection::account() {
+  auto bytes = sizeof(Http2Connection) + SSL_MEMORY_ESTIMATE +
+               recv_buffer.capacity() + send_buffer.capacity() +
+               input.capacity() + output.capacity() + header_block.capacity();
+  for (auto &pair : streams) {
+    bytes += pair.second.body.capacity();
+  }
+  memory_accountant.update(id, accounted_bytes, bytes);
+  accounted_bytes = bytes;
+}
+
+// 所有 Client 以 StatusCode::LibraryError 结束，从 memory_accountant 中移除
+Http2Connection::~Http2Connection() {
+  fail(StatusCode::LibraryError);
+  for (auto client : clients) {
+    client->connection = nullptr;
+  }
+  memory_accountant.remove(id, accounted_bytes);
+}
@@ -0,0 +1,130 @@
+#ifndef _E_HTTP2CONNECTION_H_
+#define _E_HTTP2CONNECTION_H_
+
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include "Hpack.h"
+#include "Shared/StatusCode.h"
+#include "TlsSocket.h"
+
+class Client;
+
+// 与一个 host 之间的 HTTP/2 连接（RFC 7540），多个 Client 作为 stream 共用
+// 同一个 TLS session 和 App 中的同一个 socket
+// 连接由 App 通过 e_work 驱动：完成握手后为等待中的 Client 打开 stream，
+// 读取并分发帧；某个 Client 的 stream 结束或出错时通过 o_ready 通知 App
+// 只实现客户端需要的部分：不接受 server push，不使用优先级；请求体按对方
+// 的流量控制窗口分段发送
+class Http2Connection : public TlsSocket {
+ public:
+  enum State {
+    Connecting,
+    Open,
+    Closed,
+  };
+
+ protected:
+  // 目标主机，用于 SNI、证书校验和统计
+  const std::string hostname;
+  State state = Connecting;
+  // 收到 GOAWAY 后不再打开新的 stream，已有的 stream 结束后关闭连接
+  bool going_away = false;
+  // 明文中尚未处理的部分，最多一个不完整的帧
+  std::string input;
+  // 等待写入 WolfSSL 的明文帧
+  std::string output;
+  HpackDecoder hpack;
+  struct Stream {
+    Client *client;
+    // 自上次 WINDOW_UPDATE 以来收到的 DATA 长度
+    uint32_t received;
+    // 对方为该 stream 留出的发送窗口，对方减小初始窗口时可以为负
+    int64_t send_window;
+    // 请求体和其中已经发出的长度，发完后释放
+    std::string body;
+    size_t body_sent;
+  };
+
+  // 所有使用该连接、尚未释放的 Client
+  std::set<Client *> clients;
+  // 等待打开 stream 的 Client
+  std::deque<Client *> waiting;
+  // 已打开的 stream
+  std::map<uint32_t, Stream> streams;
+  // 自上次连接级 WINDOW_UPDATE 以来收到的 DATA 长度
+  uint32_t connection_received = 0;
+  // 对方留出的连接级发送窗口，以及对方的 SETTINGS_INITIAL_WINDOW_SIZE
+  int64_t connection_send_window = 65535;
+  uint32_t initial_send_window = 65535;
+  // 下一个 stream id，客户端使用奇数
+  uint32_t next_stream_id = 1;
+  // 对方的 SETTINGS_MAX_CONCURRENT_STREAMS 和 SETTINGS_MAX_FRAME_SIZE
+  uint32_t max_concurrent_streams = 100;
+  uint32_t max_frame_size = 1 << 14;
+  // 正在接收的 header block（HEADERS 和之后的 CONTINUATION）
+  uint32_t header_stream = 0;
+  bool header_end_stream = false;
+  std::string header_block;
+  // 上次 account() 时记入 memory_accountant 的字节数
+  size_t accounted_bytes = 0;
+
+  // 握手并检查 ALPN 协商的结果，成功后写入连接前言和 SETTINGS
+  StatusCode connect();
+
+  // 读取所有可用的明文并处理其中完整的帧
+  StatusCode read();
+
+  // 将 output 写入 WolfSSL 并发送
+  StatusCode write();
+
+  // 追加一个帧到 output
+  void write_frame(uint8_t type, uint8_t flags, uint32_t stream_id,
+                   const char *payload, size_t size);
+
+  // 为等待中的 Client 打开 stream，不超过对方允许的并发数，之后发送窗口
+  // 允许的请求体
+  void open_streams();
+
+  // 在连接和各 stream 的发送窗口内发送剩余的请求体，其余的等待
+  // WINDOW_UPDATE
+  void send_bodies();
+
+  // 处理一个完整的帧，返回错误时关闭整个连接
+  StatusCode process_frame(uint8_t type, uint8_t flags, uint32_t stream_id,
+                           const char *payload, size_t size);
+
+  // 处理一个完整的 header block
+  StatusCode process_headers();
+
+  // 结束一个 stream，status 为 StatusCode::Success 时表示响应完整
+  void close_stream(uint32_t stream_id, StatusCode status);
+
+  // 关闭连接，所有 Client 以 status 结束
+  void fail(StatusCode status);
+
+ public:
+  Http2Connection(const std::string &hostname, int id);
+
+  // Client 创建时加入等待队列，连接打开后为其打开 stream
+  void attach(Client *client);
+
+  // Client 释放时调用，之后不再访问该 Client
+  void detach(Client *client);
+
+  // 对应 socket 准备好时调用，连接正常时返回 StatusCode::Blocking，
+  // 否则返回错误代码，之后 App 应当移除该连接
+  StatusCode work();
+
+  // 将当前在 Enclave 堆中的占用更新到 memory_accountant，每次 work() 后调用
+  void account();
+
+  const std::string &get_hostname() const { return hostname; }
+
+  // 所有 Client 以 StatusCode::LibraryError 结束，从 memory_accountant 中移除
+  ~Http2Connection();
+};
+
+#endif  // _E_HTTP2CONNECTION_H_
@@ -0,0 +1,480 @@
+// 按 RFC 1951/1952/1950 解压，Huffman 解码的方式参考 zlib 的 puff.c
+#include "Inflater.h"
+#include <algorithm>
+#include <tuple>
+
+static const short length_base[29] = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const short length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                       1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                       4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const short distance_base[30] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const short distance_extra[30] = {0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                                         4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                                         9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+const size_t WINDOW_MASK = (1 << 15) - 1;
+// gzip 头部（含 FEXTRA、FNAME 和 FCOMMENT）的长度上限
+const size_t MAX_GZIP_HEADER_SIZE = 1 << 16;
+
+Inflater::Inflater(Format format, size_t max_output)
+    : encoding(format), max_output(max_output) {}
+
+// 从输入中取 need 位，输入不足时返回 false
+bool Inflater::bits(int need, int &value) {
+  auto buffer = bit_buffer;
+  auto count = bit_count;
+  while (count < need) {
+    if (pos == input.size()) {
+      return false;
+    }
+    buffer |= (uint32_t)(unsigned char)input[pos++] << count;
+    count += 8;
+  }
+  value = (int)(buffer & ((1u << need) - 1));
+  bit_buffer = buffer >> need;
+  bit_count = count - need;
+  return true;
+}
+
+// 按 Huffman 编码取一个符号，输入不足时返回 false，编码无效时 symbol 为 -1
+bool Inflater::decode(const Huffman &huffman, int &symbol) {
+  int code = 0, first = 0, index = 0;
+  for (int length = 1; length <= 15; length++) {
+    int bit;
+    if (!bits(1, bit)) {
+      return false;
+    }
+    code |= bit;
+    int count = huffman.count[length];
+    if (code - count < first) {
+      symbol = huffman.symbol[index + (code - first)];
+      return true;
+    }
+    index += count;
+    first = (first + count) << 1;
+    code <<= 1;
+  }
+  symbol = -1;
+  return true;
+}
+
+// 根据各符号的编码长度构造 Huffman 编码，返回值同 zlib 的 puff：
+// 0 为完整编码，正数为不完整编码，负数为无效编码
+int Inflater::construct(Huffman &huffman, const short *lengths, int n) {
+  std::fill(std::begin(huffman.count), std::end(huffman.count), 0);
+  for (int symbol = 0; symbol < n; symbol++) {
+    huffman.count[lengths[symbol]]++;
+  }
+  if (huffman.count[0] == n) {
+    return 0;
+  }
+  int left = 1;
+  for (int length = 1; length <= 15; length++) {
+    left <<= 1;
+    left -= huffman.count[length];
+    if (left < 0) {
+      return left;
+    }
+  }
+  short offsets[16];
+  offsets[1] = 0;
+  for (int length = 1; length < 15; length++) {
+    offsets[length + 1] = offsets[length] + huffman.count[length];
+  }
+  for (int symbol = 0; symbol < n; symbol++) {
+    if (lengths[symbol] != 0) {
+      huffman.symbol[offsets[lengths[symbol]]++] = (short)symbol;
+    }
+  }
+  return left;
+}
+
+// 固定 Huffman 编码，第一次使用时构造
+void Inflater::fixed_codes(const Huffman *&length, const Huffman *&distance) {
+  static const Huffman *codes = [] {
+    static Huffman fixed[2];
+    short lengths[288];
+    std::fill(lengths, lengths + 144, 8);
+    std::fill(lengths + 144, lengths + 256, 9);
+    std::fill(lengths + 256, lengths + 280, 7);
+    std::fill(lengths + 280, lengths + 288, 8);
+    construct(fixed[0], lengths, 288);
+    std::fill(lengths, lengths + 30, 5);
+    construct(fixed[1], lengths, 30);
+    return fixed;
+  }();
+  length = &codes[0];
+  distance = &codes[1];
+}
+
+// 输出一个字节，超过 max_output 时返回 false
+bool Inflater::emit(unsigned char c, std::string *output) {
+  if (total_output >= max_output) {
+    return false;
+  }
+  window[total_output & WINDOW_MASK] = c;
+  total_output += 1;
+  if (output != nullptr) {
+    output->push_back((char)c);
+  }
+  return true;
+}
+
+// gzip 头部，或识别 deflate 是否带有 zlib 头
+StatusCode Inflater::header() {
+  if (encoding == Deflate) {
+    if (input.size() - pos < 2) {
+      return StatusCode::Blocking;
+    }
+    auto cmf = (unsigned char)input[pos];
+    auto flg = (unsigned char)input[pos + 1];
+    if ((cmf & 0x0f) == 8 && (cmf >> 4) <= 7 && (cmf * 256 + flg) % 31 == 0 &&
+        !(flg & 0x20)) {
+      zlib = true;
+      pos += 2;
+    }
+    stage = BlockHeader;
+    return StatusCode::Success;
+  }
+  // gzip 头部按字节对齐，可变长的字段随输入到达逐字节消耗，不保留已读的部分
+  // 固定的 10 字节：ID1、ID2、CM、FLG、MTIME、XFL 和 OS
+  if (gzip_flags < 0) {
+    if (input.size() - pos < 10) {
+      return StatusCode::Blocking;
+    }
+    auto flags = (unsigned char)input[pos + 3];
+    if ((unsigned char)input[pos] != 0x1f ||
+        (unsigned char)input[pos + 1] != 0x8b || input[pos + 2] != 8 ||
+        (flags & 0xe0)) {
+      return StatusCode::DecodeError;
+    }
+    gzip_flags = flags;
+    pos += 10;
+    header_size = 10;
+  }
+  // FEXTRA，2 字节的长度和内容
+  if (gzip_flags & 4) {
+    if (!extra_length_read) {
+      if (input.size() - pos < 2) {
+        return StatusCode::Blocking;
+      }
+      extra_remaining = (unsigned char)input[pos] |
+                        ((size_t)(unsigned char)input[pos + 1] << 8);
+      extra_length_read = true;
+      pos += 2;
+      header_size += 2;
+      if (header_size + extra_remaining > MAX_GZIP_HEADER_SIZE) {
+        return StatusCode::DecodeError;
+      }
+    }
+    auto size = std::min(extra_remaining, input.size() - pos);
+    pos += size;
+    extra_remaining -= size;
+    header_size += size;
+    if (extra_remaining > 0) {
+      return StatusCode::Blocking;
+    }
+    gzip_flags &= ~4;
+  }
+  // FNAME 和 FCOMMENT，以 0 结尾
+  for (int flag : {8, 16}) {
+    while (gzip_flags & flag) {
+      if (header_size > MAX_GZIP_HEADER_SIZE) {
+        return StatusCode::DecodeError;
+      }
+      if (pos == input.size()) {
+        return StatusCode::Blocking;
+      }
+      header_size += 1;
+      if (input[pos++] == 0) {
+        gzip_flags &= ~flag;
+      }
+    }
+  }
+  // FHCRC
+  if (gzip_flags & 2) {
+    if (input.size() - pos < 2) {
+      return StatusCode::Blocking;
+    }
+    pos += 2;
+    gzip_flags &= ~2;
+  }
+  stage = BlockHeader;
+  return StatusCode::Success;
+}
+
+// 块头部，动态编码的块会同时读取全部编码表
+StatusCode Inflater::block_header() {
+  auto saved = std::make_tuple(pos, bit_buffer, bit_count);
+  auto blocking = [&] {
+    std::tie(pos, bit_buffer, bit_count) = saved;
+    return StatusCode(StatusCode::Blocking);
+  };
+  int last, type;
+  if (!bits(1, last) || !bits(2, type)) {
+    return blocking();
+  }
+  last_block = last;
+  switch (type) {
+    case 0: {
+      // 不压缩的块，丢弃当前字节剩余的位
+      bit_buffer = 0;
+      bit_count = 0;
+      int b0, b1, b2, b3;
+      if (!bits(8, b0) || !bits(8, b1) || !bits(8, b2) || !bits(8, b3)) {
+        return blocking();
+      }
+      auto length = b0 | (b1 << 8);
+      if (length != (~(b2 | (b3 << 8)) & 0xffff)) {
+        return StatusCode::DecodeError;
+      }
+      stored_remaining = (size_t)length;
+      stage = Stored;
+      return StatusCode::Success;
+    }
+    case 1: {
+      fixed_codes(length_code, distance_code);
+      stage = Codes;
+      return StatusCode::Success;
+    }
+    case 2: {
+      auto status = dynamic_header();
+      if (status == StatusCode::Blocking) {
+        return blocking();
+      } else if (status != StatusCode::Success) {
+        return status;
+      }
+      length_code = &dynamic_length;
+      distance_code = &dynamic_distance;
+      stage = Codes;
+      return StatusCode::Success;
+    }
+    default:
+      return StatusCode::DecodeError;
+  }
+}
+
+// 动态编码的编码表，输入不足时由 block_header 回退
+StatusCode Inflater::dynamic_header() {
+  static const short order[19] = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                  11, 4,  12, 3, 13, 2, 14, 1, 15};
+  int nlen, ndist, ncode;
+  if (!bits(5, nlen) || !bits(5, ndist) || !bits(4, ncode)) {
+    return StatusCode::Blocking;
+  }
+  nlen += 257;
+  ndist += 1;
+  ncode += 4;
+  if (nlen > 286 || ndist > 30) {
+    return StatusCode::DecodeError;
+  }
+  short lengths[286 + 30] = {};
+  for (int index = 0; index < ncode; index++) {
+    int length;
+    if (!bits(3, length)) {
+      return StatusCode::Blocking;
+    }
+    lengths[order[index]] = (short)length;
+  }
+  Huffman length_length;
+  if (construct(length_length, lengths, 19) != 0) {
+    return StatusCode::DecodeError;
+  }
+  int index = 0;
+  while (index < nlen + ndist) {
+    int symbol;
+    if (!decode(length_length, symbol)) {
+      return StatusCode::Blocking;
+    }
+    if (symbol < 0) {
+      return StatusCode::DecodeError;
+    }
+    if (symbol < 16) {
+      lengths[index++] = (short)symbol;
+      continue;
+    }
+    // 重复之前的长度或 0
+    short length = 0;
+    int repeat;
+    if (symbol == 16) {
+      if (index == 0) {
+        return StatusCode::DecodeError;
+      }
+      length = lengths[index - 1];
+      if (!bits(2, repeat)) {
+        return StatusCode::Blocking;
+      }
+      repeat += 3;
+    } else if (symbol == 17) {
+      if (!bits(3, repeat)) {
+        return StatusCode::Blocking;
+      }
+      repeat += 3;
+    } else {
+      if (!bits(7, repeat)) {
+        return StatusCode::Blocking;
+      }
+      repeat += 11;
+    }
+    if (index + repeat > nlen + ndist) {
+      return StatusCode::DecodeError;
+    }
+    while (repeat--) {
+      lengths[index++] = length;
+    }
+  }
+  // 必须有块结束符号
+  if (lengths[256] == 0) {
+    return StatusCode::DecodeError;
+  }
+  // 只允许仅有一个编码时不完整
+  auto left = construct(dynamic_length, lengths, nlen);
+  if (left < 0 || (left > 0 && nlen - dynamic_length.count[0] != 1)) {
+    return StatusCode::DecodeError;
+  }
+  left = construct(dynamic_distance, lengths + nlen, ndist);
+  if (left < 0 || (left > 0 && ndist - dynamic_distance.count[0] != 1)) {
+    return StatusCode::DecodeError;
+  }
+  return StatusCode::Success;
+}
+
+// 不压缩的块，直接复制
+StatusCode Inflater::stored(std::string *output) {
+  while (stored_remaining > 0) {
+    if (pos == input.size()) {
+      return StatusCode::Blocking;
+    }
+    auto size = std::min(stored_remaining, input.size() - pos);
+    for (size_t i = 0; i < size; i++) {
+      if (!emit((unsigned char)input[pos + i], output)) {
+        return StatusCode::ResponseTooLarge;
+      }
+    }
+    pos += size;
+    stored_remaining -= size;
+  }
+  stage = last_block ? Trailer : BlockHeader;
+  return StatusCode::Success;
+}
+
+// 压缩的块，每个字面量或 (长度, 距离) 为一个单元
+StatusCode Inflater::codes(std::string *output) {
+  while (true) {
+    auto saved = std::make_tuple(pos, bit_buffer, bit_count);
+    auto blocking = [&] {
+      std::tie(pos, bit_buffer, bit_count) = saved;
+      return StatusCode(StatusCode::Blocking);
+    };
+    int symbol;
+    if (!decode(*length_code, symbol)) {
+      return blocking();
+    }
+    if (symbol < 0) {
+      return StatusCode::DecodeError;
+    }
+    if (symbol < 256) {
+      if (!emit((unsigned char)symbol, output)) {
+        return StatusCode::ResponseTooLarge;
+      }
+      continue;
+    }
+    if (symbol == 256) {
+      stage = last_block ? Trailer : BlockHeader;
+      return StatusCode::Success;
+    }
+    symbol -= 257;
+    if (symbol >= 29) {
+      return StatusCode::DecodeError;
+    }
+    int extra;
+    if (!bits(length_extra[symbol], extra)) {
+      return blocking();
+    }
+    auto length = length_base[symbol] + extra;
+    if (!decode(*distance_code, symbol)) {
+      return blocking();
+    }
+    if (symbol < 0 || symbol >= 30) {
+      return StatusCode::DecodeError;
+    }
+    if (!bits(distance_extra[symbol], extra)) {
+      return blocking();
+    }
+    auto distance = (size_t)(distance_base[symbol] + extra);
+    if (distance > total_output) {
+      return StatusCode::DecodeError;
+    }
+    for (int i = 0; i < length; i++) {
+      if (!emit(window[(total_output - distance) & WINDOW_MASK], output)) {
+        return StatusCode::ResponseTooLarge;
+      }
+    }
+  }
+}
+
+// gzip 或 zlib 的结尾，从字节边界开始
+StatusCode Inflater::trailer() {
+  auto saved = std::make_tuple(pos, bit_buffer, bit_count);
+  bit_buffer = 0;
+  bit_count = 0;
+  int size = encoding == Gzip ? 8 : (zlib ? 4 : 0);
+  if (input.size() - pos < (size_t)size) {
+    std::tie(pos, bit_buffer, bit_count) = saved;
+    return StatusCode::Blocking;
+  }
+  if (encoding == Gzip) {
+    // 跳过 CRC-32，校验 ISIZE（长度模 2^32）
+    uint32_t isize = 0;
+    for (int i = 0; i < 4; i++) {
+      isize |= (uint32_t)(unsigned char)input[pos + 4 + i] << (8 * i);
+    }
+    if (isize != (uint32_t)total_output) {
+      return StatusCode::DecodeError;
+    }
+  }
+  pos += size;
+  stage = Done;
+  return StatusCode::Success;
+}
+
+// 解压一段输入，输出追加到 output（为空指针时只校验并丢弃输出）
+StatusCode Inflater::feed(const char *data, size_t size, std::string *output) {
+  if (stage == Done) {
+    // 忽略数据结束之后的内容
+    return StatusCode::Success;
+  }
+  input.append(data, size);
+  total_input += size;
+  StatusCode status = StatusCode::Success;
+  while (stage != Done && status == StatusCode::Success) {
+    switch (stage) {
+      case Header:
+        status = header();
+        break;
+      case BlockHeader:
+        status = block_header();
+        break;
+      case Stored:
+        status = stored(output);
+        break;
+      case Codes:
+        status = codes(output);
+        break;
+      case Trailer:
+        status = trailer();
+        break;
+      default:
+        UNREACHABLE();
+    }
+  }
+  // 丢弃已经解码的输入，只保留未完成的单元
+  input.erase(0, pos);
+  pos = 0;
+  return status;
+}
@@ -0,0 +1,109 @@
+#ifndef _E_INFLATER_H_
+#define _E_INFLATER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "Shared/StatusCode.h"
+
+// 流式解压 HTTP 的 gzip 和 deflate 编码，输入可以在任意位置分段
+// 内存占用为 32KB 的窗口、Huffman 表，以及最多一个未解码单元的输入：
+// 每个单元（块头、一个符号及其附加位）在输入不足时回退，等待下一段输入；
+// gzip 头部的可变长字段随输入到达直接消耗，总长度不超过 64KB
+// TLS 已经保证数据完整，不校验 CRC-32 和 Adler-32，只校验 gzip 的长度
+class Inflater {
+ public:
+  enum Format {
+    Gzip,
+    // HTTP 的 deflate，按 RFC 应带 zlib 头，但也有服务器直接发送 raw deflate，
+    // 根据前两个字节自动识别
+    Deflate,
+  };
+
+ protected:
+  enum Stage {
+    Header,
+    BlockHeader,
+    Stored,
+    Codes,
+    Trailer,
+    Done,
+  };
+
+  // 范式 Huffman 编码：各长度的编码数量和按编码排序的符号
+  struct Huffman {
+    short count[16];
+    short symbol[288];
+  };
+
+  const Format encoding;
+  // 解压后的长度上限，防止解压炸弹
+  const size_t max_output;
+  Stage stage = Header;
+  // 是否带有 zlib 头（仅 Deflate）
+  bool zlib = false;
+  // gzip 头部中尚未读取的可选字段（FLG 中的位），读取固定部分之前为 -1
+  int gzip_flags = -1;
+  // FEXTRA 的长度是否已经读取，以及剩余的长度
+  bool extra_length_read = false;
+  size_t extra_remaining = 0;
+  // 已读取的 gzip 头部长度，超过上限时视为无效
+  size_t header_size = 0;
+  // 当前块是否为最后一块
+  bool last_block = false;
+  // 未解码的输入，从 pos 开始
+  std::string input;
+  size_t pos = 0;
+  // 尚未使用的位，低位在前
+  uint32_t bit_buffer = 0;
+  int bit_count = 0;
+  // Stored 块剩余的长度
+  size_t stored_remaining = 0;
+  // 当前块使用的编码，指向 fixed_* 或 dynamic_*
+  const Huffman *length_code = nullptr;
+  const Huffman *distance_code = nullptr;
+  Huffman dynamic_length;
+  Huffman dynamic_distance;
+  // 最近 32KB 的输出，供回溯引用
+  unsigned char window[1 << 15];
+  // 已输入和已输出的总长度
+  size_t total_input = 0;
+  size_t total_output = 0;
+
+  // 从输入中取 need 位，输入不足时返回 false
+  bool bits(int need, int &value);
+  // 按 Huffman 编码取一个符号，输入不足时返回 false，编码无效时 symbol 为 -1
+  bool decode(const Huffman &huffman, int &symbol);
+  // 根据各符号的编码长度构造 Huffman 编码，返回值同 zlib 的 puff：
+  // 0 为完整编码，正数为不完整编码，负数为无效编码
+  static int construct(Huffman &huffman, const short *lengths, int n);
+  // 固定 Huffman 编码，第一次使用时构造
+  static void fixed_codes(const Huffman *&length, const Huffman *&distance);
+
+  // gzip 头部随输入到达逐步消耗，输入不足时返回 StatusCode::Blocking
+  StatusCode header();
+  // 以下函数在输入不足时回退到调用前的位置并返回 StatusCode::Blocking
+  StatusCode block_header();
+  StatusCode dynamic_header();
+  StatusCode stored(std::string *output);
+  StatusCode codes(std::string *output);
+  StatusCode trailer();
+
+  // 输出一个字节，超过 max_output 时返回 false
+  bool emit(unsigned char c, std::string *output);
+
+ public:
+  Inflater(Format format, size_t max_output);
+
+  // 解压一段输入，输出追加到 output（为空指针时只校验并丢弃输出）
+  // 返回 StatusCode::Success 表示数据已经结束，StatusCode::Blocking 表示需要
+  // 更多输入，StatusCode::DecodeError 表示数据无效，
+  // StatusCode::ResponseTooLarge 表示解压后超过 max_output
+  StatusCode feed(const char *data, size_t size, std::string *output);
+
+  bool finished() const { return stage == Done; }
+  size_t get_total_input() const { return total_input; }
+  size_t get_total_output() const { return total_output; }
+};
+
+#endif  // _E_INFLATER_H_
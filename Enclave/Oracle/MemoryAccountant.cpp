@@ -0,0 +1,38 @@
+#include "MemoryAccountant.h"
+#include "Enclave/Enclave_t.h"
+#include "Shared/Config.h"
+#include "Shared/Logging.h"
+
+MemoryAccountant memory_accountant;
+
+// 将 id 的占用从 old_bytes 更新为 new_bytes，新 Client 的 old_bytes 为 0
+void MemoryAccountant::update(int id, size_t old_bytes, size_t new_bytes) {
+  if (old_bytes == new_bytes && old_bytes != 0) {
+    return;
+  }
+  if (old_bytes != 0) {
+    by_size.erase({old_bytes, id});
+  }
+  by_size.emplace(new_bytes, id);
+  total = total - old_bytes + new_bytes;
+}
+
+// 移除 id 的占用
+void MemoryAccountant::remove(int id, size_t bytes) {
+  auto erased = by_size.erase({bytes, id});
+  ASSERT(erased == 1);
+  total -= bytes;
+}
+
+// 超过 ENCLAVE_MEMORY_PAUSE 时，暂停读取占用超过 LARGE_RESPONSE_SIZE 的
+// Client，但占用最大的 Client 继续读取，保证总有任务能完成并释放内存
+bool MemoryAccountant::should_pause(int id, size_t bytes) const {
+  if (total < (size_t)ENCLAVE_MEMORY_PAUSE ||
+      bytes < (size_t)LARGE_RESPONSE_SIZE) {
+    return false;
+  }
+  return by_size.rbegin()->second != id;
+}
+
+// 返回 Enclave 中所有 Client 缓冲的字节数，App 据此控制新任务和读取
+size_t e_memory_usage() { return memory_accountant.get_total(); }
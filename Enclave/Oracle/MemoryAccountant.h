@@ -0,0 +1,33 @@
+#ifndef _E_MEMORYACCOUNTANT_H_
+#define _E_MEMORYACCOUNTANT_H_
+
+#include <stddef.h>
+#include <set>
+#include <utility>
+
+// 统计每个 Client 在 Enclave 堆中缓冲的字节数
+// 仅在 ECALL 中访问（App 只在主线程进行 ECALL）
+class MemoryAccountant {
+ protected:
+  // 所有 Client 的占用之和
+  size_t total = 0;
+  // 按占用排序的 (字节数, id)，用于找到占用最大的 Client
+  std::set<std::pair<size_t, int>> by_size;
+
+ public:
+  // 将 id 的占用从 old_bytes 更新为 new_bytes，新 Client 的 old_bytes 为 0
+  void update(int id, size_t old_bytes, size_t new_bytes);
+
+  // 移除 id 的占用
+  void remove(int id, size_t bytes);
+
+  // 超过 ENCLAVE_MEMORY_PAUSE 时，暂停读取占用超过 LARGE_RESPONSE_SIZE 的
+  // Client，但占用最大的 Client 继续读取，保证总有任务能完成并释放内存
+  bool should_pause(int id, size_t bytes) const;
+
+  size_t get_total() const { return total; }
+};
+
+extern MemoryAccountant memory_accountant;
+
+#endif  // _E_MEMORYACCOUNTANT_H_
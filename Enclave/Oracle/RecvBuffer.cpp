@@ -0,0 +1,54 @@
+#include "RecvBuffer.h"
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include "Enclave/Enclave_t.h"
+#include "Shared/Logging.h"
+#include "sgx_trts.h"
+
+// 缓存为空时进行一次 ocall 填满缓冲区，返回值同 o_recv
+int RecvBuffer::fill(int socket) {
+  if (!data) {
+    data.reset(new char[SOCKET_RECV_BUFFER_SIZE]);
+  }
+  int recv_ret;
+  char *buffer_in;
+  o_recv(&recv_ret, socket, &buffer_in, SOCKET_RECV_BUFFER_SIZE, &errno);
+  ocall_count += 1;
+  if (recv_ret <= 0) {
+    return recv_ret;
+  }
+  // 数据位于 App 中该连接独占的缓冲区，长度和指针都来自 App，不可信
+  if (recv_ret > SOCKET_RECV_BUFFER_SIZE) {
+    ERROR("recv() got %d bytes, more than requested", recv_ret);
+    errno = EMSGSIZE;
+    return -1;
+  }
+  if (!sgx_is_outside_enclave(buffer_in, (size_t)recv_ret)) {
+    ERROR("recv() got a buffer inside the enclave");
+    errno = EFAULT;
+    return -1;
+  }
+  memcpy(data.get(), buffer_in, (size_t)recv_ret);
+  begin = 0;
+  end = (size_t)recv_ret;
+  INFO("recv() fetched %d bytes (%s)", recv_ret,
+       abstract({buffer_in, (size_t)recv_ret}).c_str());
+  return recv_ret;
+}
+
+// 读取至多 size 字节，仅在没有缓存数据时进行 ocall
+// 返回值和 errno 符合 Linux socket 的 recv()
+int RecvBuffer::recv(int socket, char *buffer, size_t size) {
+  if (begin == end) {
+    auto recv_ret = fill(socket);
+    if (recv_ret <= 0) {
+      return recv_ret;
+    }
+  }
+  // 返回已缓存的数据，不足 size 时由 WolfSSL 再次调用
+  auto size_out = std::min(size, end - begin);
+  memcpy(buffer, data.get() + begin, size_out);
+  begin += size_out;
+  return (int)size_out;
+}
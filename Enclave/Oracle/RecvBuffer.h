@@ -0,0 +1,34 @@
+#ifndef _E_RECVBUFFER_H_
+#define _E_RECVBUFFER_H_
+
+#include <stddef.h>
+#include <memory>
+#include "Shared/Config.h"
+
+// 每个连接独占的接收缓冲区，随连接创建，反复使用
+// WolfSSL 读取时会先请求 5 字节的 TLS 头部，再请求记录内容，
+// 为了减少 ocall 次数，每次 ocall 尽可能填满缓冲区，之后的读取直接从内存复制
+// 缓冲区在第一次读取时分配，不直接收发的连接（HTTP/2 的 stream）不占用内存
+class RecvBuffer {
+ protected:
+  std::unique_ptr<char[]> data;
+  // 有效数据为 [begin, end)
+  size_t begin = 0;
+  size_t end = 0;
+  // 进行 ocall 的次数
+  int ocall_count = 0;
+
+  // 缓存为空时进行一次 ocall 填满缓冲区，返回值同 o_recv
+  int fill(int socket);
+
+ public:
+  // 读取至多 size 字节，仅在没有缓存数据时进行 ocall
+  // 返回值和 errno 符合 Linux socket 的 recv()
+  int recv(int socket, char *buffer, size_t size);
+
+  int get_ocall_count() const { return ocall_count; }
+  // 已分配的字节数
+  size_t capacity() const { return data ? SOCKET_RECV_BUFFER_SIZE : 0; }
+};
+
+#endif  // _E_RECVBUFFER_H_
@@ -0,0 +1,211 @@
+// 多通道 SHA-512，用于同一轮中多个 Client 的 report_data 计算
+#include "Sha512Batch.h"
+#include <stdint.h>
+#include <string.h>
+#include <wolfssl/wolfcrypt/sha512.h>
+#include "sgx_cpuid.h"
+
+// 4 个 64 位通道，使用 GCC 向量扩展，在 AVX2 函数中编译为 ymm 指令
+// 仅有 SSE2 时拆成两半执行反而比逐个计算慢，因此不使用
+typedef uint64_t u64x4 __attribute__((vector_size(32)));
+const int LANES = 4;
+const int BLOCK_SIZE = 128;
+
+static const uint64_t k[80] = {
+    0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL,
+    0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
+    0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL,
+    0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+    0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL,
+    0xc19bf174cf692694ULL, 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL,
+    0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL, 0x2de92c6f592b0275ULL,
+    0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+    0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL,
+    0xbf597fc7beef0ee4ULL, 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+    0x06ca6351e003826fULL, 0x142929670a0e6e70ULL, 0x27b70a8546d22ffcULL,
+    0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+    0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL,
+    0x92722c851482353bULL, 0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL,
+    0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL, 0xd192e819d6ef5218ULL,
+    0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+    0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL,
+    0x34b0bcb5e19b48a8ULL, 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL,
+    0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL, 0x748f82ee5defb2fcULL,
+    0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+    0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL,
+    0xc67178f2e372532bULL, 0xca273eceea26619cULL, 0xd186b8c721c0c207ULL,
+    0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL, 0x06f067aa72176fbaULL,
+    0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+    0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
+    0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
+    0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL};
+
+static const uint64_t initial_state[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL,
+    0xa54ff53a5f1d36f1ULL, 0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+    0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL};
+
+// 每个通道的消息，最后不满一块的部分和填充保存在 tail 中
+struct Lane {
+  const unsigned char *data;
+  size_t full_blocks;
+  size_t total_blocks;
+  unsigned char tail[2 * BLOCK_SIZE];
+};
+
+static bool use_avx2 = false;
+
+static inline uint64_t load_be64(const unsigned char *p) {
+  uint64_t x;
+  memcpy(&x, p, sizeof(x));
+  return __builtin_bswap64(x);
+}
+
+static inline void store_be64(unsigned char *p, uint64_t x) {
+  x = __builtin_bswap64(x);
+  memcpy(p, &x, sizeof(x));
+}
+
+// 使用宏而非函数，避免在未启用 AVX 的代码中以 ymm 传参
+#define ROTR64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+
+// 准备通道：计算块数，生成填充后的最后 1~2 块
+static void init_lane(Lane &lane, const unsigned char *message, size_t size) {
+  lane.data = message;
+  lane.full_blocks = size / BLOCK_SIZE;
+  auto tail_size = size % BLOCK_SIZE;
+  // 0x80 和 128 位长度至少需要 17 字节
+  auto tail_blocks = tail_size + 17 <= BLOCK_SIZE ? 1 : 2;
+  lane.total_blocks = lane.full_blocks + tail_blocks;
+  memset(lane.tail, 0, sizeof(lane.tail));
+  memcpy(lane.tail, message + lane.full_blocks * BLOCK_SIZE, tail_size);
+  lane.tail[tail_size] = 0x80;
+  auto end = lane.tail + tail_blocks * BLOCK_SIZE;
+  store_be64(end - 16, (uint64_t)(size >> 61));
+  store_be64(end - 8, (uint64_t)size << 3);
+}
+
+// 对 4 个通道各压缩一块，inactive 的通道保持状态不变
+__attribute__((always_inline)) static inline void compress(
+    u64x4 *state, const unsigned char *const *blocks, const u64x4 &active) {
+  u64x4 w[16];
+  u64x4 s[8];
+  for (int i = 0; i < 8; i++) {
+    s[i] = state[i];
+  }
+  for (int t = 0; t < 80; t++) {
+    u64x4 wt;
+    if (t < 16) {
+      wt = u64x4{load_be64(blocks[0] + 8 * t), load_be64(blocks[1] + 8 * t),
+                 load_be64(blocks[2] + 8 * t), load_be64(blocks[3] + 8 * t)};
+    } else {
+      auto w15 = w[(t - 15) & 15];
+      auto w2 = w[(t - 2) & 15];
+      auto s0 = ROTR64(w15, 1) ^ ROTR64(w15, 8) ^ (w15 >> 7);
+      auto s1 = ROTR64(w2, 19) ^ ROTR64(w2, 61) ^ (w2 >> 6);
+      wt = w[t & 15] + s0 + w[(t - 7) & 15] + s1;
+    }
+    w[t & 15] = wt;
+    auto e = s[4];
+    auto a = s[0];
+    auto ch = (e & s[5]) ^ (~e & s[6]);
+    auto maj = (a & s[1]) ^ (a & s[2]) ^ (s[1] & s[2]);
+    auto t1 =
+        s[7] + (ROTR64(e, 14) ^ ROTR64(e, 18) ^ ROTR64(e, 41)) + ch + k[t] + wt;
+    auto t2 = (ROTR64(a, 28) ^ ROTR64(a, 34) ^ ROTR64(a, 39)) + maj;
+    s[7] = s[6];
+    s[6] = s[5];
+    s[5] = e;
+    s[4] = s[3] + t1;
+    s[3] = s[2];
+    s[2] = s[1];
+    s[1] = a;
+    s[0] = t1 + t2;
+  }
+  for (int i = 0; i < 8; i++) {
+    state[i] = ((state[i] + s[i]) & active) | (state[i] & ~active);
+  }
+}
+
+// 以 4 个通道处理 lanes 中的消息，count 不足 4 时其余通道不参与
+__attribute__((target("avx2"))) static void process_lanes_avx2(
+    const Lane *lanes, int count,
+    unsigned char (*digests)[SHA512_BATCH_DIGEST_SIZE]) {
+  static const unsigned char zero_block[BLOCK_SIZE] = {0};
+  u64x4 state[8];
+  for (int i = 0; i < 8; i++) {
+    state[i] = u64x4{initial_state[i], initial_state[i], initial_state[i],
+                     initial_state[i]};
+  }
+  size_t max_blocks = 0;
+  for (int l = 0; l < count; l++) {
+    if (lanes[l].total_blocks > max_blocks) {
+      max_blocks = lanes[l].total_blocks;
+    }
+  }
+  for (size_t b = 0; b < max_blocks; b++) {
+    const unsigned char *blocks[LANES];
+    u64x4 active;
+    for (int l = 0; l < LANES; l++) {
+      if (l < count && b < lanes[l].total_blocks) {
+        auto &lane = lanes[l];
+        blocks[l] = b < lane.full_blocks
+                        ? lane.data + b * BLOCK_SIZE
+                        : lane.tail + (b - lane.full_blocks) * BLOCK_SIZE;
+        active[l] = ~0ULL;
+      } else {
+        blocks[l] = zero_block;
+        active[l] = 0;
+      }
+    }
+    compress(state, blocks, active);
+  }
+  for (int l = 0; l < count; l++) {
+    for (int i = 0; i < 8; i++) {
+      store_be64(digests[l] + 8 * i, state[i][l]);
+    }
+  }
+}
+
+// 检测 CPU 是否支持 AVX2，在 e_init 中调用一次
+void sha512_batch_init() {
+  int info[4];
+  // leaf 1: ecx 的 OSXSAVE (27) 和 AVX (28)
+  if (sgx_cpuidex(info, 1, 0) != SGX_SUCCESS ||
+      (info[2] & (3 << 27)) != (3 << 27)) {
+    return;
+  }
+  // Enclave 内 XCR0 即为 Enclave 的 XFRM，需要启用 SSE (1) 和 AVX (2) 状态
+  uint32_t xcr0_low, xcr0_high;
+  __asm__ volatile("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+  if ((xcr0_low & 6) != 6) {
+    return;
+  }
+  // leaf 7: ebx 的 AVX2 (5)
+  if (sgx_cpuidex(info, 7, 0) != SGX_SUCCESS || !(info[1] & (1 << 5))) {
+    return;
+  }
+  use_avx2 = true;
+}
+
+// 同时计算多个消息的 SHA-512，支持 AVX2 时每 4 个消息作为 4 个通道并行处理，
+// 其余情况逐个使用 WolfSSL 计算
+void sha512_batch(const unsigned char *const *messages, const size_t *sizes,
+                  int count, unsigned char (*digests)[SHA512_BATCH_DIGEST_SIZE]) {
+  int i = 0;
+  // 至少有 2 个消息时才使用多通道
+  for (; use_avx2 && count - i >= 2; i += LANES) {
+    Lane lanes[LANES];
+    int lane_count = count - i < LANES ? count - i : LANES;
+    for (int l = 0; l < lane_count; l++) {
+      init_lane(lanes[l], messages[i + l], sizes[i + l]);
+    }
+    process_lanes_avx2(lanes, lane_count, digests + i);
+  }
+  for (; i < count; i++) {
+    Sha512 sha512;
+    wc_InitSha512(&sha512);
+    wc_Sha512Update(&sha512, messages[i], (unsigned)sizes[i]);
+    wc_Sha512Final(&sha512, digests[i]);
+  }
+}
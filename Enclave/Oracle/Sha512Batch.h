@@ -0,0 +1,18 @@
+#ifndef _E_SHA512BATCH_H_
+#define _E_SHA512BATCH_H_
+
+#include <stddef.h>
+
+const int SHA512_BATCH_DIGEST_SIZE = 64;
+
+// 检测 CPU 是否支持 AVX2，在 e_init 中调用一次
+// Enclave 内不能执行 CPUID，通过 sgx_cpuidex 向 App 查询，
+// 结果仅用于选择实现，并通过 XCR0 确认 Enclave 启用了 AVX 状态
+void sha512_batch_init();
+
+// 同时计算多个消息的 SHA-512，支持 AVX2 时每 4 个消息作为 4 个通道并行处理，
+// 其余情况逐个使用 WolfSSL 计算
+void sha512_batch(const unsigned char *const *messages, const size_t *sizes,
+                  int count, unsigned char (*digests)[SHA512_BATCH_DIGEST_SIZE]);
+
+#endif  // _E_SHA512BATCH_H_
@@ -0,0 +1,175 @@
+// Enclave 的热状态快照：WolfSSL 的 session 缓存和每个 host 的统计信息
+// 用 sgx_seal_data 加密后交给 App 写入文件，重启后通过 e_restore 恢复
+#include "Snapshot.h"
+#include <string.h>
+#include <memory>
+#include "Enclave/Enclave_t.h"
+#include "Shared/Logging.h"
+#include "Shared/StatusCode.h"
+#include "WolfSSL.h"
+#include "sgx_trts.h"
+#include "sgx_tseal.h"
+
+std::map<std::string, HostStats> host_stats;
+
+const uint32_t SNAPSHOT_MAGIC = 0x50414e53;  // "SNAP"
+// 格式改变时递增，旧版本的快照会被拒绝
+const uint32_t SNAPSHOT_VERSION = 1;
+
+struct SnapshotHeader {
+  uint32_t magic;
+  uint32_t version;
+  // 紧随其后的 session 缓存长度，未启用 PERSIST_SESSION_CACHE 时为 0
+  uint32_t session_cache_size;
+  // 之后 host 的数量，每个为 uint32_t 长度、hostname 和 HostStats
+  uint32_t host_count;
+};
+
+// 在 plain 后追加一个 POD 对象
+template <typename T>
+static void append(std::string &plain, const T &value) {
+  plain.append((const char *)&value, sizeof(T));
+}
+
+// 从 p 读取一个 POD 对象并后移，剩余长度不足时返回 false
+template <typename T>
+static bool consume(const char *&p, const char *end, T &value) {
+  if ((size_t)(end - p) < sizeof(T)) {
+    return false;
+  }
+  memcpy(&value, p, sizeof(T));
+  p += sizeof(T);
+  return true;
+}
+
+// 将当前状态写入 plain
+static StatusCode serialize(std::string &plain) {
+  SnapshotHeader header = {SNAPSHOT_MAGIC, SNAPSHOT_VERSION, 0,
+                           (uint32_t)host_stats.size()};
+#ifdef PERSIST_SESSION_CACHE
+  header.session_cache_size = (uint32_t)wolfSSL_get_session_cache_memsize();
+#endif
+  append(plain, header);
+#ifdef PERSIST_SESSION_CACHE
+  auto offset = plain.size();
+  plain.resize(offset + header.session_cache_size);
+  if (wolfSSL_memsave_session_cache(&plain[offset],
+                                    (int)header.session_cache_size) !=
+      SSL_SUCCESS) {
+    ERROR("Failed to save session cache");
+    return StatusCode::LibraryError;
+  }
+#endif
+  for (auto &pair : host_stats) {
+    append(plain, (uint32_t)pair.first.size());
+    plain.append(pair.first);
+    append(plain, pair.second);
+  }
+  return StatusCode::Success;
+}
+
+// 从 plain 恢复状态，任何格式错误都返回 StatusCode::InvalidSnapshot
+static StatusCode deserialize(const std::string &plain) {
+  auto p = plain.data();
+  auto end = p + plain.size();
+  SnapshotHeader header;
+  if (!consume(p, end, header) || header.magic != SNAPSHOT_MAGIC ||
+      header.version != SNAPSHOT_VERSION ||
+      (size_t)(end - p) < header.session_cache_size) {
+    return StatusCode::InvalidSnapshot;
+  }
+#ifdef PERSIST_SESSION_CACHE
+  // WolfSSL 会检查缓存的行数和大小，编译选项不同时拒绝恢复
+  if (header.session_cache_size > 0 &&
+      wolfSSL_memrestore_session_cache(p, (int)header.session_cache_size) !=
+          SSL_SUCCESS) {
+    ERROR("Session cache in snapshot does not match, skipped");
+  }
+#endif
+  p += header.session_cache_size;
+  std::map<std::string, HostStats> restored;
+  for (uint32_t i = 0; i < header.host_count; i++) {
+    uint32_t hostname_size;
+    if (!consume(p, end, hostname_size) ||
+        (size_t)(end - p) < hostname_size) {
+      return StatusCode::InvalidSnapshot;
+    }
+    std::string hostname(p, hostname_size);
+    p += hostname_size;
+    if (!consume(p, end, restored[hostname])) {
+      return StatusCode::InvalidSnapshot;
+    }
+  }
+  host_stats.swap(restored);
+  LOG("Restored session cache of %u bytes and stats of %u hosts",
+      header.session_cache_size, header.host_count);
+  return StatusCode::Success;
+}
+
+// 将当前状态封装后写入 p_sealed，*p_sealed_size 总是设为所需的长度
+// capacity 不足时返回 StatusCode::BufferTooSmall，App 应按所需长度重新调用
+int e_snapshot(void *p_sealed, size_t capacity, size_t *p_sealed_size) {
+  // user_check 指针，指向 Enclave 内时写入会破坏 Enclave 的内存
+  if (p_sealed_size == nullptr ||
+      !sgx_is_outside_enclave(p_sealed_size, sizeof(size_t)) ||
+      (capacity > 0 && (p_sealed == nullptr ||
+                        !sgx_is_outside_enclave(p_sealed, capacity)))) {
+    ERROR("Invalid snapshot buffer");
+    return StatusCode::InvalidArgument;
+  }
+  std::string plain;
+  auto status = serialize(plain);
+  if (status.is_error()) {
+    return status;
+  }
+  auto sealed_size = sgx_calc_sealed_data_size(0, (uint32_t)plain.size());
+  if (sealed_size == UINT32_MAX) {
+    return StatusCode::LibraryError;
+  }
+  *p_sealed_size = sealed_size;
+  if (capacity < sealed_size) {
+    return StatusCode::BufferTooSmall;
+  }
+  // sgx_seal_data 的输出必须位于 Enclave 内，完成后再复制到 App
+  std::unique_ptr<uint8_t[]> sealed(new uint8_t[sealed_size]);
+  if (sgx_seal_data(0, nullptr, (uint32_t)plain.size(),
+                    (const uint8_t *)plain.data(), sealed_size,
+                    (sgx_sealed_data_t *)sealed.get()) != SGX_SUCCESS) {
+    ERROR("Failed to seal snapshot");
+    return StatusCode::LibraryError;
+  }
+  memcpy(p_sealed, sealed.get(), sealed_size);
+  LOG("Snapshot sealed: %u bytes", sealed_size);
+  return StatusCode::Success;
+}
+
+// 解封 e_snapshot 生成的数据并恢复状态，需要在 e_init 之后、创建连接之前调用
+int e_restore(const void *p_sealed, size_t sealed_size) {
+  // 指向 Enclave 内时会把 Enclave 的内存当作快照读入
+  if (p_sealed == nullptr || !sgx_is_outside_enclave(p_sealed, sealed_size)) {
+    ERROR("Invalid snapshot buffer");
+    return StatusCode::InvalidArgument;
+  }
+  if (global_ctx == nullptr) {
+    return StatusCode::Uninitialized;
+  }
+  if (sealed_size < sizeof(sgx_sealed_data_t) || sealed_size > UINT32_MAX) {
+    return StatusCode::InvalidSnapshot;
+  }
+  // 同样先复制到 Enclave 内再解封
+  std::unique_ptr<uint8_t[]> sealed(new uint8_t[sealed_size]);
+  memcpy(sealed.get(), p_sealed, sealed_size);
+  auto p_data = (const sgx_sealed_data_t *)sealed.get();
+  auto plain_size = sgx_get_encrypt_txt_len(p_data);
+  if (plain_size == UINT32_MAX ||
+      sgx_calc_sealed_data_size(0, plain_size) != sealed_size) {
+    return StatusCode::InvalidSnapshot;
+  }
+  std::string plain(plain_size, '\0');
+  if (sgx_unseal_data(p_data, nullptr, nullptr, (uint8_t *)&plain[0],
+                      &plain_size) != SGX_SUCCESS) {
+    ERROR("Failed to unseal snapshot");
+    return StatusCode::InvalidSnapshot;
+  }
+  return deserialize(plain);
+}
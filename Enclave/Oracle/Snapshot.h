@@ -0,0 +1,23 @@
+#ifndef _E_SNAPSHOT_H_
+#define _E_SNAPSHOT_H_
+
+#include <stdint.h>
+#include <map>
+#include <string>
+
+// 每个 host 的统计信息，随快照保存，Enclave 重启后继续累计
+struct HostStats {
+  // 完成握手的连接数
+  uint32_t connections;
+  // 其中复用了 TLS session 的连接数
+  uint32_t resumed;
+  // 成功返回结果的任务数
+  uint32_t completed;
+  // 出错的任务数
+  uint32_t failed;
+};
+
+// 以 hostname 为 key，只在 ECALL 中访问（App 仅在主线程调用 e_work）
+extern std::map<std::string, HostStats> host_stats;
+
+#endif  // _E_SNAPSHOT_H_
@@ -0,0 +1,115 @@
+#include "TlsSocket.h"
+#include <errno.h>
+#include <wolfssl/wolfio.h>
+#include "Enclave/Enclave_t.h"
+#include "Shared/Logging.h"
+
+// 给定 WolfSSL 对于某一操作的返回值，
+// 返回 StatusCode::Success, StatusCode::LibraryError 或 StatusCode::Blocking
+StatusCode TlsSocket::parse_wolfssl_status(int ret) const {
+  if (ret == SSL_SUCCESS) {
+    return StatusCode::Success;
+  } else {
+    // WolfSSL 应当返回等待 IO 的错误代码
+    auto err = wolfSSL_get_error(ssl, ret);
+    switch (err) {
+      case SSL_ERROR_WANT_READ:
+      case SSL_ERROR_WANT_WRITE:
+        return StatusCode::Blocking;
+      default:
+        ERROR("Socket %d failed with message: %s", id,
+              get_wolfssl_error_str(err));
+        return StatusCode::LibraryError;
+    }
+  }
+  UNREACHABLE();
+}
+
+// 发送 send_buffer 中缓存的数据，非阻塞，需要重复调用直到返回
+// StatusCode::Success
+StatusCode TlsSocket::flush() {
+  while (sent_size < send_buffer.size()) {
+    int send_ret;
+    o_send(&send_ret, id, send_buffer.data() + sent_size,
+           (int)(send_buffer.size() - sent_size), &errno);
+    send_ocall_count += 1;
+    if (send_ret > 0) {
+      sent_size += (size_t)send_ret;
+    } else if (errno == EWOULDBLOCK) {
+      return StatusCode::Blocking;
+    } else {
+      ERROR("Socket %d failed to send", id);
+      return StatusCode::LibraryError;
+    }
+  }
+  send_buffer.clear();
+  sent_size = 0;
+  return StatusCode::Success;
+}
+
+// 根据错误代码，打印 WolfSSL 的错误信息
+const char *TlsSocket::get_wolfssl_error_str(int err) const {
+  static char buffer[89] = "WOLFSSL: ";
+  wolfSSL_ERR_error_string((unsigned long)err, buffer + 9);
+  return buffer;
+}
+
+// open 为 false 时不创建 WolfSSL 对象
+TlsSocket::TlsSocket(int id, bool open)
+    : id(id), ssl(open ? wolfSSL_new(global_ctx) : nullptr) {
+  if (ssl != nullptr) {
+    wolfSSL_SetIOReadCtx(ssl, this);
+    wolfSSL_SetIOWriteCtx(ssl, this);
+  }
+}
+
+// 释放 ssl 对象
+TlsSocket::~TlsSocket() {
+  if (ssl != nullptr) {
+    LOG("Free SSL object");
+    wolfSSL_free(ssl);
+  }
+}
+
+// WolfSSL 读取数据的回调，ctx 为对应的 TlsSocket
+int recv_callback(WOLFSSL *, char *buffer, int size, void *ctx) {
+  auto &socket = *(TlsSocket *)ctx;
+  // 等待对方回复前，先发出缓存的记录
+  switch (socket.flush()) {
+    case StatusCode::Success:
+      break;
+    case StatusCode::Blocking:
+      // App 已经在等待 socket 可写，之后会再次调用
+      return WOLFSSL_CBIO_ERR_WANT_READ;
+    default:
+      return WOLFSSL_CBIO_ERR_GENERAL;
+  }
+  auto ret = socket.recv_buffer.recv(socket.id, buffer, (size_t)size);
+  if (ret > 0) {
+    return ret;
+  } else if (ret == 0) {
+    return WOLFSSL_CBIO_ERR_CONN_CLOSE;
+  } else if (errno == EWOULDBLOCK) {
+    return WOLFSSL_CBIO_ERR_WANT_READ;
+  } else {
+    return WOLFSSL_CBIO_ERR_GENERAL;
+  }
+}
+
+// WolfSSL 发送数据的回调，ctx 为对应的 TlsSocket
+// 仅写入缓存，在读取回复前或缓存过大时才进行 ocall
+int send_callback(WOLFSSL *, char *buffer, int size, void *ctx) {
+  auto &socket = *(TlsSocket *)ctx;
+  if (socket.send_buffer.size() >= SOCKET_SEND_BUFFER_SIZE) {
+    switch (socket.flush()) {
+      case StatusCode::Success:
+        break;
+      case StatusCode::Blocking:
+        return WOLFSSL_CBIO_ERR_WANT_WRITE;
+      default:
+        return WOLFSSL_CBIO_ERR_GENERAL;
+    }
+  }
+  socket.send_buffer.append(buffer, (size_t)size);
+  return size;
+}
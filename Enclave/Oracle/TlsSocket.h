@@ -0,0 +1,59 @@
+#ifndef _E_TLSSOCKET_H_
+#define _E_TLSSOCKET_H_
+
+#include <string>
+#include "RecvBuffer.h"
+#include "Shared/StatusCode.h"
+#include "WolfSSL.h"
+
+// 通过 App 中的 socket 收发 TLS 记录，Client 和 Http2Connection 共用
+// WolfSSL 的 IO 回调以其为 ctx
+class TlsSocket {
+ protected:
+  // 与 App 中共享的 id，o_recv 和 o_send 据此找到 socket
+  const int id;
+  // Session，HTTP/2 的 stream 经由 Http2Connection 收发，为空指针
+  WOLFSSL *const ssl;
+  // 接收缓冲区，WolfSSL 的小读取从这里复制
+  RecvBuffer recv_buffer;
+  // WolfSSL 写出的 TLS 记录先缓存在这里，在需要等待对方回复时一次性发送，
+  // 使握手中同一轮的多个记录只需一次 ocall
+  std::string send_buffer;
+  // send_buffer 中已经发送的长度
+  size_t sent_size = 0;
+  // 进行 o_send 的次数
+  int send_ocall_count = 0;
+
+  // 给定 WolfSSL 对于某一操作的返回值，
+  // 返回 StatusCode::Success, StatusCode::LibraryError 或 StatusCode::Blocking
+  StatusCode parse_wolfssl_status(int ret) const;
+
+  // 发送 send_buffer 中缓存的数据，非阻塞，需要重复调用直到返回
+  // StatusCode::Success
+  StatusCode flush();
+
+  // 根据错误代码，打印 WolfSSL 的错误信息
+  const char *get_wolfssl_error_str(int err) const;
+
+  // open 为 false 时不创建 WolfSSL 对象
+  TlsSocket(int id, bool open);
+
+  // 释放 ssl 对象
+  ~TlsSocket();
+
+ public:
+  // 禁止 copy 和 move
+  TlsSocket(const TlsSocket &) = delete;
+  TlsSocket(TlsSocket &&) = delete;
+  TlsSocket operator=(const TlsSocket &) = delete;
+  TlsSocket operator=(TlsSocket &&) = delete;
+
+  friend int recv_callback(WOLFSSL *, char *buffer, int size, void *ctx);
+  friend int send_callback(WOLFSSL *, char *buffer, int size, void *ctx);
+};
+
+// WolfSSL 的 IO 回调，在 e_init 中注册，ctx 为对应的 TlsSocket
+int recv_callback(WOLFSSL *, char *buffer, int size, void *ctx);
+int send_callback(WOLFSSL *, char *buffer, int size, void *ctx);
+
+#endif  // _E_TLSSOCKET_H_
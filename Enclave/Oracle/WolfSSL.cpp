@@ -1,32 +1,112 @@
 #include "WolfSSL.h"
+#include <stdlib.h>
+#include <wolfssl/wolfcrypt/memory.h>
+#include <atomic>
 #include <map>
-#include "CA.h"
+#include <memory>
+#include <vector>
+#include "CA_der.h"
 #include "Client.h"
 #include "Enclave/Enclave.h"
 #include "Enclave/Enclave_t.h"
-#include "Shared/EnclaveResult.h"
+#include "Http2Connection.h"
 #include "Shared/Logging.h"
 #include "Shared/StatusCode.h"
+#include "Sha512Batch.h"
+#include "Snapshot.h"
 
 #include "sgx_trts.h"
 
 WOLFSSL_CTX *global_ctx = nullptr;
 sgx_target_info_t target_info;
 
+#ifdef MEASURE_WOLFSSL_HEAP
+// 经 WolfSSL 分配、尚未释放的堆内存字节数，用于统计 CA 证书等的占用
+// 只在以 make MEASURE_HEAP=1 编译时计数，否则 WolfSSL 直接使用 malloc
+static std::atomic<size_t> wolfssl_heap_bytes(0);
+
+// 每块内存前的头部，记录其大小，保持 16 字节对齐
+struct alignas(16) AllocationHeader {
+  size_t size;
+};
+
+static void *counting_malloc(size_t size) {
+  auto header = (AllocationHeader *)malloc(sizeof(AllocationHeader) + size);
+  if (header == nullptr) {
+    return nullptr;
+  }
+  header->size = size;
+  wolfssl_heap_bytes += size;
+  return header + 1;
+}
+
+static void counting_free(void *ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+  auto header = (AllocationHeader *)ptr - 1;
+  wolfssl_heap_bytes -= header->size;
+  free(header);
+}
+
+static void *counting_realloc(void *ptr, size_t size) {
+  if (ptr == nullptr) {
+    return counting_malloc(size);
+  }
+  auto header = (AllocationHeader *)ptr - 1;
+  auto old_size = header->size;
+  header = (AllocationHeader *)realloc(header, sizeof(AllocationHeader) + size);
+  if (header == nullptr) {
+    return nullptr;
+  }
+  header->size = size;
+  wolfssl_heap_bytes += size;
+  wolfssl_heap_bytes -= old_size;
+  return header + 1;
+}
+#endif
+
 // 初始化系统
 int e_init(const void *p_target_info) {
   // 记录 target_info
   ASSERT(sgx_is_outside_enclave(p_target_info, sizeof(sgx_target_info_t)));
   memcpy(&target_info, p_target_info, sizeof(sgx_target_info_t));
+  // 选择批量 hash 的实现
+  sha512_batch_init();
   // 初始化 WolfSSL
   // wolfSSL_Debugging_ON();
+#ifdef MEASURE_WOLFSSL_HEAP
+  wolfSSL_SetAllocators(counting_malloc, counting_free, counting_realloc);
+#endif
   wolfSSL_Init();
   // 创建 ctx
   auto method = wolfSSLv23_client_method();
   auto ctx = wolfSSL_CTX_new(method);
-  // 加载 CA 证书
-  wolfSSL_CTX_load_verify_buffer(ctx, (const unsigned char *)ca_certs_raw,
-                                 strlen(ca_certs_raw), SSL_FILETYPE_PEM);
+  // 使用 Client 的 IO 回调，通过 IO ctx 直接找到对应的 Client
+  wolfSSL_CTX_SetIORecv(ctx, recv_callback);
+  wolfSSL_CTX_SetIOSend(ctx, send_callback);
+  // 加载 CA 证书，构建时已转换为 DER，省去 PEM 的 base64 解码
+  double start = current_time();
+#ifdef MEASURE_WOLFSSL_HEAP
+  size_t heap_before = wolfssl_heap_bytes;
+#endif
+  int loaded = 0;
+  for (int i = 0; i < ca_der_count; i++) {
+    if (wolfSSL_CTX_load_verify_buffer(ctx, ca_ders[i], ca_der_sizes[i],
+                                       SSL_FILETYPE_ASN1) == SSL_SUCCESS) {
+      loaded++;
+    } else {
+      ERROR("Failed to load CA certificate %d", i);
+    }
+  }
+#ifdef MEASURE_WOLFSSL_HEAP
+  LOG("Loaded %d/%d CA certificates in %.3f ms, heap %lu -> %lu bytes",
+      loaded, ca_der_count, (current_time() - start) * 1000,
+      (unsigned long)heap_before, (unsigned long)wolfssl_heap_bytes);
+#else
+  LOG("Loaded %d/%d CA certificates in %.3f ms", loaded, ca_der_count,
+      (current_time() - start) * 1000);
+#endif
   // 保存 ctx
   global_ctx = ctx;
   LOG("Context initialized");
@@ -35,11 +115,15 @@ int e_init(const void *p_target_info) {
 
 // Client 连接通过 socket 进行查找
 std::map<int, Client> workers;
+// HTTP/2 连接同样通过 socket 进行查找，其上的 Client 仍在 workers 中
+std::map<int, Http2Connection> connections;
 
 // 创建一个新的 SSL 连接，返回连接的 id
 // App 内需要确保 socket 是唯一的
+// connection_id 非负时作为该 HTTP/2 连接上的一个 stream，不使用自己的 socket
 int e_new_ssl(int socket_id, const char *hostname, size_t hostname_size,
-              const char *request, size_t request_size) {
+              const char *request, size_t request_size, int streaming,
+              int connection_id) {
   ASSERT(sgx_is_outside_enclave(hostname, hostname_size));
   ASSERT(sgx_is_outside_enclave(request, request_size));
   // 检验 ctx 已经初始化
@@ -47,36 +131,88 @@ int e_new_ssl(int socket_id, const char *hostname, size_t hostname_size,
     return StatusCode::Uninitialized;
   }
   // 检查连接是否达到上限
-  if (workers.size() >= MAX_WORKER) {
+  if (workers.size() + connections.size() >= MAX_WORKER) {
     return StatusCode::NoAvailableWorker;
   }
   // socket_id 必须是唯一的
-  if (workers.find(socket_id) != workers.cend()) {
+  if (workers.find(socket_id) != workers.cend() ||
+      connections.find(socket_id) != connections.cend()) {
     ERROR("socket_id not unique");
     return StatusCode::Unknown;
   }
+  // 找到所在的 HTTP/2 连接，流式任务不使用 HTTP/2
+  Http2Connection *connection = nullptr;
+  if (connection_id >= 0) {
+    auto iter = connections.find(connection_id);
+    if (iter == connections.end() || streaming) {
+      ERROR("No connection with id %d for client %d", connection_id,
+            socket_id);
+      return StatusCode::Unknown;
+    }
+    connection = &iter->second;
+  }
   // 创建 client
   workers.emplace(
       std::piecewise_construct, std::make_tuple(socket_id),
       std::make_tuple(std::string(hostname, hostname_size),
-                      std::string(request, request_size), socket_id));
+                      std::string(request, request_size), socket_id,
+                      streaming != 0, connection));
   LOG("Created SSL with id %d", socket_id);
   return StatusCode::Success;
 }
 
+// 创建一个到 hostname 的 HTTP/2 连接，之后由 e_new_ssl 在其上创建 Client
+// App 内需要确保 socket 是唯一的
+int e_new_connection(int socket_id, const char *hostname,
+                     size_t hostname_size) {
+  ASSERT(sgx_is_outside_enclave(hostname, hostname_size));
+  if (global_ctx == nullptr) {
+    return StatusCode::Uninitialized;
+  }
+  if (workers.size() + connections.size() >= MAX_WORKER) {
+    return StatusCode::NoAvailableWorker;
+  }
+  if (workers.find(socket_id) != workers.cend() ||
+      connections.find(socket_id) != connections.cend()) {
+    ERROR("socket_id not unique");
+    return StatusCode::Unknown;
+  }
+  connections.emplace(
+      std::piecewise_construct, std::make_tuple(socket_id),
+      std::make_tuple(std::string(hostname, hostname_size), socket_id));
+  LOG("Created HTTP/2 connection with id %d", socket_id);
+  return StatusCode::Success;
+}
+
 // 移除指定的 SSL 连接
+// 移除连接时，其上尚未完成的 Client 以错误结束
 void e_remove_ssl(int id) {
   if (workers.erase(id)) {
     LOG("Removed worker %d", id);
+  } else if (connections.erase(id)) {
+    LOG("Removed connection %d", id);
   }
 }
 
 // 根据 id 令指定的 SSL 连接进行工作
-// 如果处理完成，则将网页写入 p_result 指向的空间
-int e_work(int id, void *p_result) {
+// 如果处理完成，则将结果的长度写入 p_result_size，App 分配空间后通过
+// e_get_result 取得结果
+int e_work(int id, size_t *p_result_size) {
   // 检查指针范围
-  ASSERT(sgx_is_outside_enclave(p_result, sizeof(EnclaveResult)));
-  auto &result = *(EnclaveResult *)p_result;
+  ASSERT(sgx_is_outside_enclave(p_result_size, sizeof(size_t)));
+  // HTTP/2 连接不会完成，只会阻塞或出错
+  auto connection_iter = connections.find(id);
+  if (connection_iter != connections.end()) {
+    auto &connection = connection_iter->second;
+    auto status = connection.work();
+    connection.account();
+    if (status.is_error()) {
+      ERROR("Connection %d failed with error '%s', freeing", id,
+            status.message());
+      connections.erase(connection_iter);
+    }
+    return status;
+  }
   // 根据 id 找到指定的 worker
   auto iter = workers.find(id);
   if (iter == workers.cend()) {
@@ -86,38 +222,100 @@ int e_work(int id, void *p_result) {
   auto &worker = iter->second;
   // 执行操作
   auto status = worker.work();
+  worker.account();
   switch (status) {
     case StatusCode::Success: {
-      // 执行完成
-      // 写入回复
-      auto &response = worker.get_response();
-      if (response.size() >= sizeof(result.data)) {
-        // 结果过长，报错
-        ERROR("Client %d failed: response too long, freeing", id);
-        workers.erase(iter);
-        return StatusCode::ResponseTooLarge;
-      }
-      memcpy(result.data, response.data(), response.size());
-      result.data_size = (int)response.size();
-      // 写入 report
-      result.report = worker.get_report();
-      // 释放空间
-      LOG("Client %d finished, freeing", id);
-      workers.erase(iter);
+      // 执行完成，告知结果长度，等待 e_get_result
+      *p_result_size = worker.get_response().size();
       return StatusCode::Success;
     }
     case StatusCode::Blocking: {
       // 正在等待 IO
       return StatusCode::Blocking;
     }
+    case StatusCode::Quoting: {
+      // 等待 e_quote_batch 生成 report
+      return StatusCode::Quoting;
+    }
+    case StatusCode::Throttled: {
+      // 内存紧张，暂停读取
+      return StatusCode::Throttled;
+    }
     default: {
       // 出现错误
       ASSERT(status.is_error());
       // 释放空间
       ERROR("Client %d failed with error '%s', freeing", id, status.message());
+      host_stats[worker.get_hostname()].failed += 1;
       workers.erase(iter);
       return status;
     }
   }
   UNREACHABLE();
+}
+
+// 将完成的 Client 的结果直接写入 App 按 e_work 给出的长度分配的 buffer，
+// 并写入 report，之后释放该 Client
+int e_get_result(int id, char *buffer, size_t capacity, void *p_report) {
+  // 两者都是 user_check 指针，指向 Enclave 内时写入会破坏 Enclave 的内存
+  if (!sgx_is_outside_enclave(buffer, capacity) || p_report == nullptr ||
+      !sgx_is_outside_enclave(p_report, sizeof(sgx_report_t))) {
+    ERROR("Invalid result buffer for worker %d", id);
+    return StatusCode::InvalidArgument;
+  }
+  auto iter = workers.find(id);
+  if (iter == workers.cend() ||
+      iter->second.get_state() != Client::Complete) {
+    ERROR("No completed worker with id %d", id);
+    return StatusCode::Unknown;
+  }
+  auto &worker = iter->second;
+  auto &response = worker.get_response();
+  if (capacity < response.size()) {
+    return StatusCode::BufferTooSmall;
+  }
+  memcpy(buffer, response.data(), response.size());
+  memcpy(p_report, &worker.get_report(), sizeof(sgx_report_t));
+  host_stats[worker.get_hostname()].completed += 1;
+  // 释放空间
+  LOG("Client %d finished, freeing", id);
+  workers.erase(iter);
+  return StatusCode::Success;
+}
+
+// 为所有等待中的 Client 批量计算打包数据的 hash 并生成 report
+// 返回生成 report 的数量
+int e_quote_batch() {
+  std::vector<Client *> clients;
+  std::vector<const unsigned char *> messages;
+  std::vector<size_t> sizes;
+  int streamed = 0;
+  for (auto &pair : workers) {
+    auto &client = pair.second;
+    if (client.get_state() != Client::Quoting) {
+      continue;
+    }
+    if (client.is_streaming()) {
+      // 流式模式已经在读取时算出 hash
+      client.create_report(client.get_stream_digest());
+      streamed += 1;
+      continue;
+    }
+    auto &response = client.get_response();
+    clients.push_back(&client);
+    messages.push_back((const unsigned char *)response.data());
+    sizes.push_back(response.size());
+  }
+  auto count = (int)clients.size();
+  if (count == 0) {
+    return streamed;
+  }
+  LOG("Hashing %d clients in batch", count);
+  std::unique_ptr<unsigned char[][SHA512_BATCH_DIGEST_SIZE]> digests(
+      new unsigned char[count][SHA512_BATCH_DIGEST_SIZE]);
+  sha512_batch(messages.data(), sizes.data(), count, digests.get());
+  for (int i = 0; i < count; i += 1) {
+    clients[i]->create_report(digests[i]);
+  }
+  return count + streamed;
 }
\ No newline at end of file
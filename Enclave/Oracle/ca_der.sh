@@ -0,0 +1,61 @@
+#!/bin/sh
+# 从 CA.h 中提取 PEM 格式的根证书，转换为 DER 并输出 C 头文件
+# 在构建时由 Makefile 调用，避免 Enclave 每次启动时解析 PEM
+#
+# 用法: ca_der.sh <CA.h> [pattern...]
+# 给出 pattern 时，只保留 subject 中包含任一 pattern 的证书
+set -e
+
+input=$1
+shift
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+# 去掉 C 字符串的引号、结尾的 \n 和 ;，每个证书拆分为一个文件
+sed -n 's/^ *"\(.*\)\\n";*$/\1/p' "$input" | awk -v dir="$tmp" '
+  /-----BEGIN CERTIFICATE-----/ { n += 1; file = sprintf("%s/%04d.pem", dir, n) }
+  { print > file }
+  /-----END CERTIFICATE-----/ { close(file) }
+'
+
+echo "// 由 Enclave/Oracle/ca_der.sh 根据 CA.h 生成，请勿修改"
+echo "#ifndef _E_CA_DER_H_"
+echo "#define _E_CA_DER_H_"
+echo
+
+count=0
+sizes=""
+names=""
+for pem in "$tmp"/*.pem; do
+  subject=$(openssl x509 -in "$pem" -noout -subject)
+  if [ $# -gt 0 ]; then
+    matched=0
+    for pattern in "$@"; do
+      case "$subject" in
+        *"$pattern"*) matched=1 ;;
+      esac
+    done
+    [ $matched -eq 1 ] || continue
+  fi
+  openssl x509 -in "$pem" -outform DER -out "$tmp/cert.der"
+  echo "// $subject"
+  echo "static const unsigned char ca_der_$count[] = {"
+  od -An -v -tx1 "$tmp/cert.der" | sed 's/ *\([0-9a-f][0-9a-f]\)/0x\1, /g; s/^/   /; s/, $/,/'
+  echo "};"
+  echo
+  sizes="$sizes $(wc -c < "$tmp/cert.der"),"
+  names="$names ca_der_$count,"
+  count=$((count + 1))
+done
+
+if [ $count -eq 0 ]; then
+  echo "ca_der.sh: no certificate matches the given patterns" >&2
+  exit 1
+fi
+
+echo "const static int ca_der_count = $count;"
+echo "const static unsigned char *const ca_ders[] = {$names};"
+echo "const static unsigned ca_der_sizes[] = {$sizes};"
+echo
+echo "#endif  // _E_CA_DER_H_"
@@ -8,15 +8,82 @@ using namespace std::chrono;
 
 // 最多同时维持连接数量
 const int MAX_WORKER = 1024;
+// 同一进程中创建的 Enclave 数量，任务按 id 分配到各个 Enclave，各自使用
+// 独立的堆（HeapMaxSize），总的可用堆随数量增加；所有 ECALL 仍由 Oracle
+// 的主线程依次发出，并不增加并发，可由 App 的第一个参数覆盖
+const int ENCLAVE_NUM = 1;
 // socket 单次读取长度
 const int SOCKET_READ_SIZE = 8192;
-// 如果网页响应超过此长度则会丢弃
+// Enclave 中每个连接的接收缓冲区大小（须为 2 的幂），每次 ocall 尽量将其填满
+const int SOCKET_RECV_BUFFER_SIZE = 1 << 14;
+// Enclave 中合并待发送 TLS 记录的缓存上限，超过时立即发送
+const int SOCKET_SEND_BUFFER_SIZE = 1 << 14;
+// 如果网页响应超过此长度则会丢弃，压缩的响应体解压后同样受此限制
+// （流式模式不受限制）
 const int MAX_RESPONSE_SIZE = 1 << 20;  // 1MB
-// 在 App 中用一个单独的（线程不应冲突）buffer 保存 Enclave 返回的数据
-const int APP_RESPONSE_BUFFER_SIZE = 1 << 23;  // 8MB
+// 响应使用 gzip 或 deflate 压缩时，report 证明解压后的响应体；
+// 为 false 时证明 base64 编码的原始压缩数据（仍会完整解压以检查有效性）
+const bool ATTEST_DECODED_BODY = true;
+// 流式模式下，Enclave 中累积的明文达到此长度时通过 o_stream 交给 App
+const int STREAM_CHUNK_SIZE = 1 << 16;
+// 估计每个 WolfSSL 连接在 Enclave 堆中占用的内存（记录缓冲区、密钥等）
+const int SSL_MEMORY_ESTIMATE = 1 << 15;
+// Enclave 内缓冲数据的上限，须小于 Enclave.config.xml 中的 HeapMaxSize（64MB）
+// 超过 ENCLAVE_MEMORY_ADMIT 时 App 不再向该 Enclave 分配新任务
+const int ENCLAVE_MEMORY_ADMIT = 32 << 20;
+// 超过 ENCLAVE_MEMORY_PAUSE 时暂停读取较大的响应，数据留在内核的 socket 缓冲区
+const int ENCLAVE_MEMORY_PAUSE = 48 << 20;
+// 占用超过此大小的响应在内存紧张时会被暂停读取
+const int LARGE_RESPONSE_SIZE = 1 << 16;
+// 为 true 时非流式任务经由 HTTP/2 连接发出，同一 Enclave 中访问同一主机的
+// 任务作为 stream 共用一个连接（需要以 make HTTP2=1 编译）
+const bool USE_HTTP2 = false;
+// App 在一个 HTTP/2 连接上同时挂载的 stream 上限，超出时新建连接
+const int HTTP2_MAX_STREAMS = 100;
+// HTTP/2 连接和每个 stream 的接收窗口，决定对方不等待 WINDOW_UPDATE
+// 可以发送的数据量
+const int HTTP2_WINDOW_SIZE = 1 << 20;
+// 压力测试（app [enclave_num] stress [host]）默认访问的主机：本机 443 端口
+// 的 HTTPS 服务，其证书须由 Enclave/Oracle/CA.h 中的根证书签发；不要指向
+// 第三方的生产服务
+#define STRESS_HOST "localhost"
 // 处理 IAS 的连接数
 const int IAS_POOL_SIZE = 128;
+// 运行 IAS 连接（TLS 握手、加解密和 HTTP 解析）的线程数
+const int IAS_THREADS = 4;
+// 缓存的 IAS 回复数量上限，quote body 相同的 quote 在 IAS_CACHE_TTL 内
+// 直接使用缓存的回复，不再请求 IAS
+const int IAS_CACHE_SIZE = 4096;
+#define IAS_CACHE_TTL 60s
+// IAS 连续失败达到此次数后熔断，IAS_BREAKER_COOLDOWN 内新任务直接失败，
+// 之后放行一个任务试探
+const int IAS_BREAKER_THRESHOLD = 16;
+#define IAS_BREAKER_COOLDOWN 5s
+// 单个 IAS 任务最多尝试的次数
+const int IAS_MAX_ATTEMPTS = 3;
+// 所有 IAS 任务共用的重试预算：重试次数不超过任务数的 IAS_RETRY_PERCENT%，
+// 另有最多 IAS_RETRY_RESERVE 次的余量
+const int IAS_RETRY_PERCENT = 10;
+const int IAS_RETRY_RESERVE = 32;
+// IAS 连接失败后重连前的退避时间，每次连续失败加倍，直到上限
+#define IAS_BACKOFF_BASE 100ms
+#define IAS_BACKOFF_MAX 10s
+// IAS 报告签名证书链的根证书（Intel SGX Attestation Report Signing CA），
+// 不随代码提供，需从 Intel 下载：
+// https://certificates.trustedservices.intel.com/Intel_SGX_Attestation_RootCA.pem
+// 文件不存在时所有 IAS 回复都标记为未验证
+#define IAS_ROOT_CA_FILE "App/Oracle/ias_root_ca.pem"
+// 可以接受的 isvEnclaveQuoteStatus，其他状态（GROUP_REVOKED、
+// SIGNATURE_INVALID 等）的回复即使签名有效也标记为未验证；平台需要更新
+// 时 IAS 返回 GROUP_OUT_OF_DATE 等，按部署的安全要求决定是否加入
+const char* const IAS_ACCEPTED_QUOTE_STATUS[] = {"OK"};
 // 单个完整任务超时时限
 #define TASK_TIMEOUT 10s
+// 相同主机和请求的非流式任务在先创建的任务开始后此时间内到达时，
+// 不再单独执行，而是共用其结果
+#define COALESCE_WINDOW 1s
+// App 中缓存已完成结果的总大小上限，任务可以指定接受的结果新鲜度，
+// 缓存中足够新的结果直接交出，不再访问和证明
+const int RESULT_CACHE_SIZE = 16 << 20;
 
 #endif  // _SHARED_CONFIG_H_
\ No newline at end of file
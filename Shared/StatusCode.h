@@ -13,12 +13,18 @@ struct StatusCode {
   enum Code : int {
     Success,
     Blocking,
+    Quoting,
+    Throttled,
     Uninitialized,
     NoAvailableWorker,
     ResponseTooLarge,
     ParserError,
     LibraryError,
     Timeout,
+    BufferTooSmall,
+    InvalidSnapshot,
+    DecodeError,
+    InvalidArgument,
     Unknown,
   } code;
 
@@ -28,6 +34,10 @@ struct StatusCode {
         return "Success.";
       case Blocking:
         return "IO operation blocking.";
+      case Quoting:
+        return "Waiting for report to be created in batch.";
+      case Throttled:
+        return "Reading paused until enclave memory is released.";
       case Uninitialized:
         return "Something uninitialized.";
       case NoAvailableWorker:
@@ -40,6 +50,14 @@ struct StatusCode {
         return "3rd-party library error.";
       case Timeout:
         return "Timeout.";
+      case BufferTooSmall:
+        return "Output buffer too small.";
+      case InvalidSnapshot:
+        return "Snapshot corrupted or from another version.";
+      case DecodeError:
+        return "Failed to decode compressed HTTP body.";
+      case InvalidArgument:
+        return "Invalid pointer or size passed to the enclave.";
       case Unknown:
         return "WTF?";
       default: { UNREACHABLE(); }
@@ -50,6 +68,8 @@ struct StatusCode {
     switch (code) {
       case Success:
       case Blocking:
+      case Quoting:
+      case Throttled:
         return false;
       case Uninitialized:
       case NoAvailableWorker:
@@ -57,6 +77,10 @@ struct StatusCode {
       case ParserError:
       case LibraryError:
       case Timeout:
+      case BufferTooSmall:
+      case InvalidSnapshot:
+      case DecodeError:
+      case InvalidArgument:
       case Unknown:
         return true;
       default: { UNREACHABLE(); }
@@ -451,6 +451,44 @@ enum http_host_state
 #define IS_HEADER_CHAR(ch)                                                     \
   (ch == CR || ch == LF || ch == 9 || ((unsigned char)ch > 31 && ch != 127))
 
+/* Skip over bytes in [p, pe) that can never end a header value: returns the
+ * first byte that is a control character (< 0x20, which covers CR, LF and
+ * TAB) or DEL, or pe if there is none. The caller still checks that byte with
+ * the regular per-byte rules, so stopping early (e.g. on TAB) is harmless.
+ *
+ * Header values are mostly printable text, so 16 bytes are tested at a time
+ * with SSE2. SSE2 is part of the x86-64 baseline and needs neither CPUID nor
+ * intrinsics headers, so the same path is used inside the enclave.
+ */
+static const char* skip_header_value_chars(const char* p, const char* pe)
+{
+#if defined(__SSE2__)
+  typedef unsigned char v16qu __attribute__((vector_size(16)));
+  typedef char v16qi __attribute__((vector_size(16)));
+  const v16qu space = {32, 32, 32, 32, 32, 32, 32, 32,
+                       32, 32, 32, 32, 32, 32, 32, 32};
+  const v16qu del = {127, 127, 127, 127, 127, 127, 127, 127,
+                     127, 127, 127, 127, 127, 127, 127, 127};
+  while (pe - p >= 16) {
+    v16qu x;
+    memcpy(&x, p, sizeof(x));
+    v16qi stop = (v16qi) ((x < space) | (x == del));
+    int mask = __builtin_ia32_pmovmskb128(stop);
+    if (mask) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 16;
+  }
+#endif
+  for (; p != pe; p++) {
+    unsigned char c = (unsigned char) *p;
+    if (c < 32 || c == 127) {
+      break;
+    }
+  }
+  return p;
+}
+
 #define start_state (parser->type == HTTP_REQUEST ? s_start_req : s_start_res)
 
 
@@ -1511,6 +1549,9 @@ reexecute:
                 const char* pe = p + MIN(left, max_header_size);
 
                 for (; p != pe; p++) {
+                  p = skip_header_value_chars(p, pe);
+                  if (p == pe)
+                    break;
                   ch = *p;
                   if (ch == CR || ch == LF) {
                     --p;
@@ -20,7 +20,6 @@
  */
 #ifndef http_parser_h
 #define http_parser_h
-#include <functional>
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -87,11 +86,8 @@ typedef struct http_parser_settings http_parser_settings;
  * many times for each string. E.G. you might get 10 callbacks for "on_url"
  * each providing just a few characters more data.
  */
-// 使用 std::function 以便传入 lambda
-typedef std::function<int(http_parser*, const char*, size_t)> http_data_cb;
-typedef std::function<int(http_parser*)> http_cb;
-// typedef int (*http_data_cb) (http_parser*, const char *at, size_t length);
-// typedef int (*http_cb) (http_parser*);
+typedef int (*http_data_cb) (http_parser*, const char *at, size_t length);
+typedef int (*http_cb) (http_parser*);
 
 
 /* Status Codes */
@@ -2,6 +2,14 @@
 #include <cstdio>
 #include "sha256.h"
 
+// CPUID cannot be executed inside an enclave, so the hardware path is only
+// compiled for the App side.
+#if !defined(SGX_IN_ENCLAVE) && defined(__x86_64__)
+#define SHA256_HAVE_SHANI
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
 #define SHA2_SHFR(x, n)    (x >> n)
 #define SHA2_ROTR(x, n)   ((x >> n) | (x << ((sizeof(x) << 3) - n)))
 #define SHA2_ROTL(x, n)   ((x << n) | (x >> ((sizeof(x) << 3) - n)))
@@ -44,7 +52,90 @@ const unsigned int SHA256::sha256_k[64] = //UL = uint32
              0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
              0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
  
+#ifdef SHA256_HAVE_SHANI
+static bool cpu_has_shani()
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    bool ssse3 = ecx & bit_SSSE3;
+    bool sse41 = ecx & bit_SSE4_1;
+    if (__get_cpuid_max(0, nullptr) < 7) {
+        return false;
+    }
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return ssse3 && sse41 && (ebx & (1u << 29));
+}
+
+// Intel SHA extensions: two rounds per sha256rnds2, message schedule with
+// sha256msg1/sha256msg2. The state is kept as ABEF/CDGH lanes.
+__attribute__((target("sha,sse4.1")))
+static void transform_shani(unsigned int *h, const unsigned int *k,
+                            const unsigned char *message,
+                            unsigned int block_nb)
+{
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+                                        0x0405060700010203ULL);
+    __m128i tmp = _mm_loadu_si128((const __m128i *) &h[0]);
+    __m128i state1 = _mm_loadu_si128((const __m128i *) &h[4]);
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);             // CDAB
+    state1 = _mm_shuffle_epi32(state1, 0x1B);       // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);  // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);    // CDGH
+
+    while (block_nb--) {
+        __m128i abef_save = state0;
+        __m128i cdgh_save = state1;
+        __m128i w[4];
+        for (int i = 0; i < 4; i++) {
+            w[i] = _mm_shuffle_epi8(
+                _mm_loadu_si128((const __m128i *) (message + 16 * i)), mask);
+        }
+        for (int g = 0; g < 16; g++) {
+            __m128i msg = _mm_add_epi32(
+                w[g & 3], _mm_loadu_si128((const __m128i *) &k[4 * g]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            if (g >= 3 && g < 15) {
+                tmp = _mm_alignr_epi8(w[g & 3], w[(g + 3) & 3], 4);
+                w[(g + 1) & 3] = _mm_add_epi32(w[(g + 1) & 3], tmp);
+                w[(g + 1) & 3] = _mm_sha256msg2_epu32(w[(g + 1) & 3],
+                                                      w[g & 3]);
+            }
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+            if (g >= 1 && g < 13) {
+                w[(g + 3) & 3] = _mm_sha256msg1_epu32(w[(g + 3) & 3],
+                                                      w[g & 3]);
+            }
+        }
+        state0 = _mm_add_epi32(state0, abef_save);
+        state1 = _mm_add_epi32(state1, cdgh_save);
+        message += 64;
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);          // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1);       // DCHG
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);    // DCBA
+    state1 = _mm_alignr_epi8(state1, tmp, 8);       // ABEF
+    _mm_storeu_si128((__m128i *) &h[0], state0);
+    _mm_storeu_si128((__m128i *) &h[4], state1);
+}
+#endif
+
 void SHA256::transform(const unsigned char *message, unsigned int block_nb)
+{
+#ifdef SHA256_HAVE_SHANI
+    static const bool has_shani = cpu_has_shani();
+    if (has_shani) {
+        transform_shani(m_h, sha256_k, message, block_nb);
+        return;
+    }
+#endif
+    transform_scalar(message, block_nb);
+}
+
+void SHA256::transform_scalar(const unsigned char *message, unsigned int block_nb)
 {
     uint32 w[64];
     uint32 wv[8];
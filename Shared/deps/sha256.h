@@ -55,7 +55,10 @@ public:
     static const unsigned int DIGEST_SIZE = ( 256 / 8);
  
 protected:
+    // Picks the SHA-NI implementation when the CPU supports it (App only,
+    // CPUID is not usable inside the enclave), otherwise the portable one.
     void transform(const unsigned char *message, unsigned int block_nb);
+    void transform_scalar(const unsigned char *message, unsigned int block_nb);
     unsigned int m_tot_len;
     unsigned int m_len;
     unsigned char m_block[2*SHA224_256_BLOCK_SIZE];